@@ -1,6 +1,6 @@
 #pragma once
 
-#include "Main.h"
+#include "Core.h"
 
 struct AABB {
 	glm::vec3 mCenter = { 0, 0, 0 };
@@ -40,7 +40,8 @@ struct AABB {
 		glm::vec3 mHalfSize = (max - min) * 0.5f;
 		return AABB(min + mHalfSize, mHalfSize);
 	}
-	static AABB FromVertices(const std::vector<Vertex>& vertices) {
+	template<typename TVertices>
+	static AABB FromVertices(const TVertices& vertices) {
 		if (!vertices.size()) {
 			return AABB();
 		}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include "Core.h"
+
+// Affine transform stored as the top three rows of a 4x4 matrix, the last row is always
+// 0, 0, 0, 1. 48 instead of 64 bytes, and composing two takes 36 multiplies instead of 64.
+// The rows are the columns of a GLSL mat3x4, shaders transform with vec4(p, 1.0) * m.
+
+// Largest difference between bone palettes built from Affine and from glm::mat4, relative
+// to the largest element, checked by "AnimBench poses".
+#define AFFINE_POSE_TOLERANCE 1e-4f
+struct Affine {
+	glm::vec4 mRows[3];
+
+	Affine() : mRows{ { 1, 0, 0, 0 }, { 0, 1, 0, 0 }, { 0, 0, 1, 0 } } {}
+
+	static Affine FromMat4(const glm::mat4& m) {
+		Affine a;
+		for (int r = 0; r < 3; ++r) {
+			a.mRows[r] = { m[0][r], m[1][r], m[2][r], m[3][r] };
+		}
+		return a;
+	}
+
+	glm::mat4 ToMat4() const {
+		glm::mat4 m = glm::identity<glm::mat4>();
+		for (int r = 0; r < 3; ++r) {
+			for (int c = 0; c < 4; ++c) m[c][r] = mRows[r][c];
+		}
+		return m;
+	}
+
+	// Same as translate(t) * mat4_cast(r) * scale(s), r must be normalized.
+	static Affine FromTRS(const glm::vec3& t, const glm::quat& r, const glm::vec3& s) {
+		const float xx = r.x * r.x, yy = r.y * r.y, zz = r.z * r.z;
+		const float xy = r.x * r.y, xz = r.x * r.z, yz = r.y * r.z;
+		const float wx = r.w * r.x, wy = r.w * r.y, wz = r.w * r.z;
+		Affine a;
+		a.mRows[0] = { (1.0f - 2.0f * (yy + zz)) * s.x, 2.0f * (xy - wz) * s.y, 2.0f * (xz + wy) * s.z, t.x };
+		a.mRows[1] = { 2.0f * (xy + wz) * s.x, (1.0f - 2.0f * (xx + zz)) * s.y, 2.0f * (yz - wx) * s.z, t.y };
+		a.mRows[2] = { 2.0f * (xz - wy) * s.x, 2.0f * (yz + wx) * s.y, (1.0f - 2.0f * (xx + yy)) * s.z, t.z };
+		return a;
+	}
+
+	glm::vec3 GetTranslation() const {
+		return { mRows[0][3], mRows[1][3], mRows[2][3] };
+	}
+
+	glm::vec3 TransformPoint(const glm::vec3& p) const {
+		return TransformVector(p) + GetTranslation();
+	}
+
+	glm::vec3 TransformVector(const glm::vec3& v) const {
+		glm::vec3 result;
+		for (int r = 0; r < 3; ++r) {
+			result[r] = mRows[r][0] * v.x + mRows[r][1] * v.y + mRows[r][2] * v.z;
+		}
+		return result;
+	}
+
+	// Largest scale along the three axes.
+	float GetMaxScale() const {
+		float scale = 0.0f;
+		for (int c = 0; c < 3; ++c) {
+			scale = std::max(scale, mRows[0][c] * mRows[0][c] + mRows[1][c] * mRows[1][c] + mRows[2][c] * mRows[2][c]);
+		}
+		return std::sqrt(scale);
+	}
+
+	Affine operator*(const Affine& b) const {
+		Affine result;
+		for (int r = 0; r < 3; ++r) {
+			const auto& row = mRows[r];
+			for (int c = 0; c < 4; ++c) {
+				result.mRows[r][c] = row[0] * b.mRows[0][c] + row[1] * b.mRows[1][c] + row[2] * b.mRows[2][c];
+			}
+			result.mRows[r][3] += row[3];
+		}
+		return result;
+	}
+};
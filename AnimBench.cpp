@@ -0,0 +1,813 @@
+#include "CpuSkinning.h"
+#include "MeshOptimizer.h"
+#include "Model.h"
+#include "Scene.h"
+#include "Skinning.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <unordered_set>
+
+#include <rapidjson/prettywriter.h>
+#include <rapidjson/stringbuffer.h>
+
+// Command line benchmarks for the animation code, no window or GL context needed.
+// Builds without GL when HEADLESS is defined, from AnimBench.cpp, Model.cpp, Scene.cpp,
+// JobSystem.cpp, ModelCache.cpp, MeshOptimizer.cpp, MeshSimplifier.cpp, CpuSkinning.cpp and the
+// Animation*.cpp files, linking only assimp.
+//
+//   AnimBench report [scene.json] [copies] [frames] [threads]
+//   AnimBench keyframes [animation.fbx...]
+//   AnimBench update [scene.json] [entities] [frames]
+//   AnimBench scaling [scene.json] [entities] [frames]
+//   AnimBench verify [animation.fbx...]
+//   AnimBench allocations [scene.json] [entities] [frames]
+//   AnimBench poses [scene.json] [entities] [frames]
+//   AnimBench skinning [scene.json] [entities] [frames]
+//   AnimBench cpuskinning [scene.json] [frames] [threads]
+//   AnimBench vertices [scene.json]
+//   AnimBench meshes [scene.json]
+
+// Heap allocations made by this process, counted by the operator new replacements below.
+std::atomic<size_t> gAllocations = { 0 };
+
+void* operator new(size_t size) {
+	gAllocations++;
+	if (void* p = malloc(size ? size : 1)) return p;
+	throw std::bad_alloc();
+}
+
+void* operator new(size_t size, std::align_val_t alignment) {
+	gAllocations++;
+#ifdef _MSC_VER
+	if (void* p = _aligned_malloc(size ? size : 1, (size_t)alignment)) return p;
+#else
+	void* p = nullptr;
+	if (posix_memalign(&p, std::max((size_t)alignment, sizeof(void*)), size ? size : 1) == 0) return p;
+#endif
+	throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+#ifdef _MSC_VER
+void operator delete(void* p, std::align_val_t) noexcept { _aligned_free(p); }
+void operator delete(void* p, size_t, std::align_val_t) noexcept { _aligned_free(p); }
+#else
+void operator delete(void* p, std::align_val_t) noexcept { free(p); }
+void operator delete(void* p, size_t, std::align_val_t) noexcept { free(p); }
+#endif
+
+const std::vector<std::string> gDefaultAnimations = {
+	"mixamo.com/Arms Hip Hop Dance.fbx",
+	"mixamo.com/Fast Run.fbx",
+	"mixamo.com/Hip Hop Dancing.fbx",
+	"mixamo.com/Idle.fbx",
+	"mixamo.com/Loser.fbx",
+	"mixamo.com/Walking.fbx",
+};
+
+template<typename TCallback>
+double Measure(TCallback callback) {
+	const auto start = std::chrono::high_resolution_clock::now();
+	callback();
+	const auto end = std::chrono::high_resolution_clock::now();
+	return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+std::vector<std::string> GetArgs(const int argc, const char** argv, const int first, const std::vector<std::string>& defaults) {
+	if (argc <= first) return defaults;
+	return std::vector<std::string>(argv + first, argv + argc);
+}
+
+// Samples every channel of every track at 60 Hz over a few loops of each clip, the same
+// access pattern AnimationController::Update has during normal playback.
+int BenchKeyFrames(const std::vector<std::string>& fileNames) {
+	constexpr float sampleRate = 60.0f;
+	constexpr int loops = 4;
+
+	for (const auto& fileName : fileNames) {
+		Model model;
+		model.LoadAnimation(fileName);
+		for (const auto& animation : model.mAnimationSet->mAnimations) {
+			size_t numKeys = 0;
+			size_t maxKeys = 0;
+			for (const auto& track : animation->mAnimationTracks) {
+				numKeys += track->mPositionKeys.size() + track->mRotationKeys.size() + track->mScalingKeys.size();
+				maxKeys = std::max({ maxKeys, track->mPositionKeys.size(), track->mRotationKeys.size(), track->mScalingKeys.size() });
+			}
+
+			const float step = 1.0f / sampleRate;
+			const float length = animation->mDuration / (animation->mTicksPerSecond ? animation->mTicksPerSecond : 25.0f);
+			const size_t numSamples = (size_t)(length * loops * sampleRate);
+			std::vector<KeyFrameCursor> cursors(animation->mAnimationTracks.size());
+			size_t checksum[3] = { 0, 0, 0 };
+
+			auto run = [&](size_t& sum, auto search) {
+				for (size_t i = 0; i < numSamples; ++i) {
+					const float time = animation->GetAnimationTime(i * step);
+					for (size_t t = 0; t < animation->mAnimationTracks.size(); ++t) {
+						const auto& track = animation->mAnimationTracks[t];
+						auto& cursor = cursors[t];
+						if (track->mPositionKeys.size() > 1) sum += search(time, track->mPositionKeys.mTimes, cursor.mPosition);
+						if (track->mRotationKeys.size() > 1) sum += search(time, track->mRotationKeys.mTimes, cursor.mRotation);
+						if (track->mScalingKeys.size() > 1) sum += search(time, track->mScalingKeys.mTimes, cursor.mScaling);
+					}
+				}
+			};
+
+			const double linear = Measure([&]() {
+				run(checksum[0], [](float time, const auto& times, size_t&) { return GetKeyFrameIndexLinear(time, times); });
+			});
+			const double binary = Measure([&]() {
+				run(checksum[1], [](float time, const auto& times, size_t&) { return GetKeyFrameIndex(time, times); });
+			});
+			const double cursor = Measure([&]() {
+				run(checksum[2], [](float time, const auto& times, size_t& cursor) { return GetKeyFrameIndex(time, times, cursor); });
+			});
+
+			std::cout << fileName << " [" << animation->mName << "]"
+				<< " tracks=" << animation->mAnimationTracks.size()
+				<< " keys=" << numKeys
+				<< " maxKeys=" << maxKeys
+				<< " samples=" << numSamples << std::endl;
+			std::cout << "  linear: " << linear << " ms" << std::endl;
+			std::cout << "  binary: " << binary << " ms (" << linear / binary << "x)" << std::endl;
+			std::cout << "  cursor: " << cursor << " ms (" << linear / cursor << "x)" << std::endl;
+			if (checksum[1] != checksum[2]) {
+				std::cerr << "  binary and cursor search disagree!" << std::endl;
+				return 1;
+			}
+		}
+	}
+	return 0;
+}
+
+struct TimingStats {
+	double mMean = 0.0;
+	double mP50 = 0.0;
+	double mP99 = 0.0;
+};
+
+TimingStats GetTimingStats(std::vector<double> values) {
+	TimingStats stats;
+	if (values.empty()) return stats;
+	std::sort(values.begin(), values.end());
+	for (const auto value : values) stats.mMean += value;
+	stats.mMean /= values.size();
+	const auto percentile = [&values](const double p) { return values[(size_t)(p * (values.size() - 1) + 0.5)]; };
+	stats.mP50 = percentile(0.5);
+	stats.mP99 = percentile(0.99);
+	return stats;
+}
+
+template<typename TWriter>
+void WriteTimingStats(TWriter& writer, const char* name, const TimingStats& stats) {
+	writer.Key(name);
+	writer.StartObject();
+	writer.Key("mean");
+	writer.Double(stats.mMean);
+	writer.Key("p50");
+	writer.Double(stats.mP50);
+	writer.Key("p99");
+	writer.Double(stats.mP99);
+	writer.EndObject();
+}
+
+// Reference run for tracking performance: numCopies copies of every entity of the scene with
+// random animation weights and time offsets, updated at 60 Hz. Frame timings are whole
+// Scene::Update calls, entity timings come from a second pass over the same frames that
+// updates one entity at a time on this thread. Prints JSON to stdout.
+int BenchReport(const std::string& fileName, const size_t numCopies, const size_t numFrames, const int numThreads) {
+	Scene scene;
+	const double loadTime = Measure([&]() {
+		scene.Load(fileName);
+		scene.FinishStreaming();
+	});
+	const auto templates = scene.mEntities;
+	if (templates.empty()) {
+		std::cerr << "No entities in " << fileName << std::endl;
+		return 1;
+	}
+	scene.mEntities.clear();
+	for (size_t copy = 0; copy < numCopies; ++copy) {
+		for (const auto& entity : templates) {
+			scene.mEntities.push_back(std::make_shared<Entity>(entity->mModel));
+		}
+	}
+	if (numThreads >= 0) scene.mNumThreads = numThreads;
+	scene.Init();
+
+	srand(0);
+	for (auto& entity : scene.mEntities) {
+		auto& ac = entity->mAnimationController;
+		if (!ac) continue;
+		for (size_t k = 0; k < ac->GetAnimationCount(); ++k) {
+			ac->SetAnimationWeight(k, (float)rand() / (float)RAND_MAX);
+		}
+		entity->mTimeOffset = 10.0f * (float)rand() / (float)RAND_MAX;
+	}
+
+	constexpr float frameTime = 1.0f / 60.0f;
+	const size_t numEntities = scene.mEntities.size();
+	std::vector<double> frameTimes(numFrames);
+	std::vector<double> entityTimes(numFrames * numEntities);
+	scene.Update(0.0f);
+	for (size_t frame = 0; frame < numFrames; ++frame) {
+		frameTimes[frame] = Measure([&]() {
+			scene.Update((frame + 1) * frameTime);
+		});
+	}
+	for (size_t frame = 0; frame < numFrames; ++frame) {
+		for (size_t i = 0; i < numEntities; ++i) {
+			entityTimes[frame * numEntities + i] = 1000.0 * Measure([&]() {
+				scene.mEntities[i]->Update((frame + 1) * frameTime);
+			});
+		}
+	}
+
+	rapidjson::StringBuffer buffer;
+	rapidjson::PrettyWriter<rapidjson::StringBuffer> writer(buffer);
+	writer.StartObject();
+	writer.Key("scene");
+	writer.String(fileName.c_str());
+	writer.Key("entities");
+	writer.Uint64(numEntities);
+	writer.Key("frames");
+	writer.Uint64(numFrames);
+	writer.Key("threads");
+	writer.Uint64(scene.mJobSystem->GetThreadCount());
+	writer.Key("kernels");
+	writer.String(GetAnimationKernels().mName);
+	writer.Key("loadMs");
+	writer.Double(loadTime);
+	WriteTimingStats(writer, "frameMs", GetTimingStats(frameTimes));
+	WriteTimingStats(writer, "entityUs", GetTimingStats(entityTimes));
+	writer.EndObject();
+	std::cout << buffer.GetString() << std::endl;
+	return 0;
+}
+
+// Replaces the entities of the scene with numEntities clones blending all their animations
+// with random weights, each with its own AnimationController. Returns the number of bones.
+size_t LoadCrowd(Scene& scene, const std::string& fileName, const size_t numEntities) {
+	scene.Load(fileName);
+	scene.FinishStreaming();
+	const auto templates = scene.mEntities;
+	scene.mEntities.clear();
+	if (templates.empty()) return 0;
+	for (size_t i = 0; i < numEntities; ++i) {
+		scene.mEntities.push_back(std::make_shared<Entity>(templates[i % templates.size()]->mModel));
+	}
+	scene.Init();
+
+	srand(0);
+	size_t numBones = 0;
+	for (auto& entity : scene.mEntities) {
+		auto& ac = entity->mAnimationController;
+		if (!ac) continue;
+		for (size_t k = 0; k < ac->GetAnimationCount(); ++k) {
+			ac->SetAnimationWeight(k, (float)rand() / (float)RAND_MAX);
+		}
+		numBones += ac->mAnimationSet->mJoints.size();
+	}
+	return numBones;
+}
+
+// Evaluates a crowd of entities cloned from the scene.
+int BenchUpdate(const std::string& fileName, const size_t numEntities, const size_t numFrames) {
+	Scene scene;
+	const size_t numBones = LoadCrowd(scene, fileName, numEntities);
+	if (scene.mEntities.empty()) {
+		std::cerr << "No entities in " << fileName << std::endl;
+		return 1;
+	}
+
+	constexpr float frameTime = 1.0f / 60.0f;
+	const double total = Measure([&]() {
+		for (size_t frame = 0; frame < numFrames; ++frame) {
+			scene.Update(frame * frameTime);
+		}
+	});
+
+	std::cout << fileName << " entities=" << numEntities << " bones=" << numBones << " frames=" << numFrames << std::endl;
+	std::cout << "  " << total / numFrames << " ms/frame" << std::endl;
+	std::cout << "  " << total * 1000.0 / numFrames / numEntities << " us/entity" << std::endl;
+	return 0;
+}
+
+// Runs the same crowd on 1 to 16 threads. Every thread count has to produce exactly the
+// bone transforms of the single threaded run.
+int BenchScaling(const std::string& fileName, const size_t numEntities, const size_t numFrames) {
+	Scene scene;
+	LoadCrowd(scene, fileName, numEntities);
+	if (scene.mEntities.empty()) {
+		std::cerr << "No entities in " << fileName << std::endl;
+		return 1;
+	}
+
+	std::cout << fileName << " entities=" << numEntities << " frames=" << numFrames << std::endl;
+	constexpr float frameTime = 1.0f / 60.0f;
+	std::vector<Affine> reference;
+	double baseline = 0.0;
+	int result = 0;
+	for (const size_t numThreads : { 1, 2, 4, 8, 16 }) {
+		scene.mJobSystem = std::make_shared<JobSystem>(numThreads);
+		scene.Update(0.0f);
+		const double total = Measure([&]() {
+			for (size_t frame = 1; frame <= numFrames; ++frame) {
+				scene.Update(frame * frameTime);
+			}
+		});
+
+		std::vector<Affine> transforms;
+		for (const auto& entity : scene.mEntities) {
+			const auto& ac = entity->mAnimationController;
+			if (ac) transforms.insert(transforms.end(), ac->mFinalTransforms.begin(), ac->mFinalTransforms.end());
+		}
+		if (reference.empty()) reference = transforms;
+		const bool identical = transforms.size() == reference.size()
+			&& memcmp(transforms.data(), reference.data(), transforms.size() * sizeof(Affine)) == 0;
+		if (!identical) result = 1;
+
+		const double entitiesPerMs = numEntities * numFrames / total;
+		if (baseline == 0.0) baseline = entitiesPerMs;
+		std::cout << "  threads=" << numThreads
+			<< " " << total / numFrames << " ms/frame"
+			<< " " << entitiesPerMs << " entities/ms"
+			<< " x" << entitiesPerMs / baseline
+			<< (identical ? "" : " MISMATCH") << std::endl;
+	}
+	return result;
+}
+
+// Fails unless Scene::Update runs numFrames without a single heap allocation once the
+// first frame has been evaluated. The first frame only plays the first clip, later frames
+// switch to each of the others in turn, so clips sampled for the first time count too.
+int CheckAllocations(const std::string& fileName, const size_t numEntities, const size_t numFrames) {
+	Scene scene;
+	LoadCrowd(scene, fileName, numEntities);
+	if (scene.mEntities.empty()) {
+		std::cerr << "No entities in " << fileName << std::endl;
+		return 1;
+	}
+	auto playClip = [&scene](const size_t frame) {
+		for (const auto& entity : scene.mEntities) {
+			const auto& ac = entity->mAnimationController;
+			if (ac && ac->GetAnimationCount()) ac->SetAnimationIndex(frame / 10 % ac->GetAnimationCount());
+		}
+	};
+
+	constexpr float frameTime = 1.0f / 60.0f;
+	playClip(0);
+	scene.Update(0.0f);
+	const size_t before = gAllocations;
+	for (size_t frame = 1; frame <= numFrames; ++frame) {
+		playClip(frame);
+		scene.Update(frame * frameTime);
+	}
+	const size_t allocations = gAllocations - before;
+
+	std::cout << fileName << " entities=" << numEntities << " frames=" << numFrames << " allocations=" << allocations
+		<< (allocations == 0 ? " OK" : " FAILED") << std::endl;
+	return allocations == 0 ? 0 : 1;
+}
+
+// Bone palette the way it was evaluated before the flat joint array and Affine: walks the
+// node hierarchy, blends the sampled poses of every clip with translate * mat4_cast * scale
+// in glm::mat4, skipping nodes that aren't bones, and applies the global inverse transform.
+void EvaluateReferencePalette(const AnimationController& ac, const AnimationNode& node, const glm::mat4& parentTransform, const glm::mat4& globalInverseTransform, std::vector<glm::mat4>& palette) {
+	const auto& animationSet = *ac.mAnimationSet;
+	const auto boneIndex = animationSet.GetBoneIndex(node.mName);
+	auto combinedTransform = parentTransform;
+	if (boneIndex != (uint32_t)-1) {
+		float totalWeight = 0.0f;
+		for (size_t k = 0; k < ac.mAnimationWeights.size(); ++k) {
+			const float w = ac.mAnimationWeights[k];
+			if (w >= ac.mMinWeight && !ac.mDisabledBones[k].Test(boneIndex)) totalWeight += w;
+		}
+		glm::mat4 nodeTransform = node.mTransform;
+		if (totalWeight > 0.0f) {
+			glm::vec3 translation = { 0, 0, 0 };
+			glm::quat rotation = glm::identity<glm::quat>();
+			glm::vec3 scale = { 0, 0, 0 };
+			for (size_t k = 0; k < ac.mAnimationWeights.size(); ++k) {
+				const float w = ac.mAnimationWeights[k];
+				if (w < ac.mMinWeight || ac.mDisabledBones[k].Test(boneIndex)) continue;
+				if (animationSet.mAnimations[k]->mBoneTracks[boneIndex] == -1) continue;
+				const float animationWeight = w / totalWeight;
+				const auto& pose = ac.mPoses[k];
+				translation += pose.mTranslations[boneIndex] * animationWeight;
+				rotation *= glm::slerp(glm::identity<glm::quat>(), pose.mRotations[boneIndex], animationWeight);
+				scale += pose.mScales[boneIndex] * animationWeight;
+			}
+			nodeTransform = glm::translate(glm::identity<glm::mat4>(), translation);
+			nodeTransform *= glm::mat4_cast(rotation);
+			nodeTransform = glm::scale(nodeTransform, scale);
+		}
+		combinedTransform *= nodeTransform;
+		palette[boneIndex] = globalInverseTransform * combinedTransform * animationSet.mBoneOffsets[boneIndex];
+	}
+	for (const auto& child : node.mChildren) {
+		EvaluateReferencePalette(ac, *child, combinedTransform, globalInverseTransform, palette);
+	}
+}
+
+// Compares the Affine palette AnimationController::Update produced for the crowd with
+// EvaluateReferencePalette. Both start from the same sampled poses, so this checks blending,
+// joint order, hierarchy and palette layout. Every other entity has one bone disabled in its
+// first clip, which takes the renormalizing path of the blend.
+int VerifyPoses(const std::string& fileName, const size_t numEntities, const size_t numFrames) {
+	Scene scene;
+	LoadCrowd(scene, fileName, numEntities);
+	if (scene.mEntities.empty()) {
+		std::cerr << "No entities in " << fileName << std::endl;
+		return 1;
+	}
+	for (size_t i = 1; i < scene.mEntities.size(); i += 2) {
+		const auto& ac = scene.mEntities[i]->mAnimationController;
+		if (ac && !ac->mDisabledBones.empty() && !ac->mFinalTransforms.empty()) {
+			ac->mDisabledBones[0].Set(i % ac->mFinalTransforms.size(), true);
+		}
+	}
+
+	constexpr float frameTime = 1.0f / 60.0f;
+	std::vector<glm::mat4> palette;
+	float maxError = 0.0f;
+	float maxElement = 0.0f;
+	size_t numBones = 0;
+	for (size_t frame = 0; frame < numFrames; ++frame) {
+		scene.Update(frame * frameTime);
+		for (const auto& entity : scene.mEntities) {
+			const auto& ac = entity->mAnimationController;
+			if (!ac || !ac->mAnimationSet->mRootNode) continue;
+			palette.assign(ac->mFinalTransforms.size(), glm::identity<glm::mat4>());
+			EvaluateReferencePalette(*ac, *ac->mAnimationSet->mRootNode, glm::identity<glm::mat4>(), entity->mModel->mGlobalInverseTransform, palette);
+			for (size_t b = 0; b < palette.size(); ++b) {
+				const auto& expected = palette[b];
+				const auto actual = ac->mFinalTransforms[b].ToMat4();
+				for (int c = 0; c < 4; ++c) {
+					for (int r = 0; r < 4; ++r) {
+						maxError = std::max(maxError, std::abs(expected[c][r] - actual[c][r]));
+						maxElement = std::max(maxElement, std::abs(expected[c][r]));
+					}
+				}
+				numBones++;
+			}
+		}
+	}
+
+	const float relativeError = maxElement > 0.0f ? maxError / maxElement : maxError;
+	const bool passed = relativeError <= AFFINE_POSE_TOLERANCE;
+	std::cout << fileName << " entities=" << numEntities << " frames=" << numFrames << " bones=" << numBones
+		<< " palette " << sizeof(glm::mat4) << " -> " << sizeof(Affine) << " bytes/bone"
+		<< " maxError=" << maxError << " relative=" << relativeError
+		<< (passed ? " OK" : " FAILED") << std::endl;
+	return passed ? 0 : 1;
+}
+
+// Skins every vertex of the crowd on the CPU with the linear and the dual quaternion
+// palette of AnimationController. Vertices bound to a single bone have to land on the
+// same spot, blended ones differ by design and are only reported.
+int VerifySkinning(const std::string& fileName, const size_t numEntities, const size_t numFrames) {
+	Scene scene;
+	LoadCrowd(scene, fileName, numEntities);
+	if (scene.mEntities.empty()) {
+		std::cerr << "No entities in " << fileName << std::endl;
+		return 1;
+	}
+	for (const auto& entity : scene.mEntities) {
+		if (entity->mAnimationController) entity->mAnimationController->SetSkinning(SkinningMode::DualQuaternion);
+	}
+
+	constexpr float frameTime = 1.0f / 60.0f;
+	float maxRigidError = 0.0f;
+	float maxBlendedError = 0.0f;
+	double sumBlendedError = 0.0;
+	size_t numRigid = 0;
+	size_t numBlended = 0;
+	float modelSize = 0.0f;
+	for (size_t frame = 0; frame < numFrames; ++frame) {
+		scene.Update(frame * frameTime);
+		for (const auto& entity : scene.mEntities) {
+			const auto& ac = entity->mAnimationController;
+			if (!ac) continue;
+			modelSize = std::max(modelSize, glm::length(entity->mModel->mAABB.mHalfSize) * 2.0f);
+			entity->mModel->mRootNode->Recurse([&](ModelNode& node) {
+				for (const auto& mesh : node.mMeshes) {
+					for (const auto& vertex : mesh->GetVertices()) {
+						if (vertex.mBoneWeights[0] <= 0.0f) continue;
+						const float error = glm::distance(SkinLinear(vertex, ac->mFinalTransforms.data()), SkinDualQuaternion(vertex, ac->mDualQuaternions.data()));
+						const float maxWeight = *std::max_element(vertex.mBoneWeights, vertex.mBoneWeights + MAX_VERTEX_WEIGHTS);
+						if (maxWeight >= 0.999f) {
+							maxRigidError = std::max(maxRigidError, error);
+							numRigid++;
+						} else {
+							maxBlendedError = std::max(maxBlendedError, error);
+							sumBlendedError += error;
+							numBlended++;
+						}
+					}
+				}
+			});
+		}
+	}
+
+	const float tolerance = DUAL_QUATERNION_TOLERANCE * std::max(modelSize, 1.0f);
+	const bool passed = maxRigidError <= tolerance;
+	std::cout << fileName << " entities=" << numEntities << " frames=" << numFrames
+		<< " palette " << sizeof(Affine) << " -> " << sizeof(DualQuat) << " bytes/bone" << std::endl;
+	std::cout << "  rigid vertices=" << numRigid << " maxError=" << maxRigidError << " tolerance=" << tolerance << std::endl;
+	std::cout << "  blended vertices=" << numBlended << " maxDifference=" << maxBlendedError
+		<< " meanDifference=" << (numBlended ? sumBlendedError / numBlended : 0.0) << std::endl;
+	std::cout << (passed ? "OK" : "FAILED") << std::endl;
+	return passed ? 0 : 1;
+}
+
+// Skins every mesh of the first animated entity on the CPU with each available kernel set,
+// on one thread and on threads (0 for every hardware thread). Poses are evaluated up front
+// so only skinning is timed. Fails if the last frame differs from SkinLinear by more than
+// CPU_SKINNING_TOLERANCE, or if the thread count changes the result.
+int BenchCpuSkinning(const std::string& fileName, const size_t numFrames, const size_t numThreads) {
+	Scene scene;
+	LoadCrowd(scene, fileName, 1);
+	if (scene.mEntities.empty() || !scene.mEntities[0]->mAnimationController) {
+		std::cerr << "No animated entities in " << fileName << std::endl;
+		return 1;
+	}
+	const auto& entity = *scene.mEntities[0];
+	const auto& ac = *entity.mAnimationController;
+
+	std::vector<Span<const Vertex>> meshes;
+	entity.mModel->mRootNode->Recurse([&](ModelNode& node) {
+		for (const auto& mesh : node.mMeshes) {
+			if (!mesh->GetVertices().empty()) meshes.push_back(mesh->GetVertices());
+		}
+	});
+	std::vector<SkinningSource> sources(meshes.size());
+	std::vector<std::vector<SkinnedVertex>> results(meshes.size()), reference(meshes.size());
+	size_t numVertices = 0;
+	for (size_t i = 0; i < meshes.size(); ++i) {
+		sources[i].Init(meshes[i]);
+		results[i].resize(meshes[i].size());
+		numVertices += meshes[i].size();
+	}
+
+	constexpr float frameTime = 1.0f / 60.0f;
+	std::vector<std::vector<Affine>> palettes(std::max<size_t>(numFrames, 1));
+	for (size_t frame = 0; frame < palettes.size(); ++frame) {
+		scene.Update(frame * frameTime);
+		palettes[frame] = ac.mFinalTransforms;
+	}
+	const auto& lastPalette = palettes.back();
+
+	const float tolerance = CPU_SKINNING_TOLERANCE * std::max(glm::length(entity.mModel->mAABB.mHalfSize) * 2.0f, 1.0f);
+	std::cout << fileName << " " << entity.mModel->mName << " meshes=" << meshes.size() << " vertices=" << numVertices
+		<< " frames=" << palettes.size() << " tolerance=" << tolerance << std::endl;
+
+	const size_t maxThreads = numThreads ? numThreads : std::max(1u, std::thread::hardware_concurrency());
+	std::vector<size_t> threadCounts = { 1 };
+	if (maxThreads > 1) threadCounts.push_back(maxThreads);
+	double baseline = 0.0;
+	int result = 0;
+	for (const auto kernels : GetAvailableSkinningKernels()) {
+		for (const size_t threads : threadCounts) {
+			JobSystem jobSystem(threads);
+			const double total = Measure([&]() {
+				for (const auto& palette : palettes) {
+					for (size_t i = 0; i < sources.size(); ++i) {
+						SkinVertices(jobSystem, *kernels, sources[i], palette.data(), results[i].data());
+					}
+				}
+			});
+
+			float maxError = 0.0f;
+			float maxNormalError = 0.0f;
+			bool identical = true;
+			for (size_t i = 0; i < meshes.size(); ++i) {
+				for (size_t v = 0; v < meshes[i].size(); ++v) {
+					const auto& vertex = meshes[i][v];
+					const auto normal = BlendLinear(vertex, lastPalette.data()).TransformVector(vertex.mNormal);
+					const float length = glm::length(normal);
+					maxError = std::max(maxError, glm::distance(SkinLinear(vertex, lastPalette.data()), results[i][v].mPos));
+					maxNormalError = std::max(maxNormalError, glm::distance(length > 0.0f ? normal / length : normal, results[i][v].mNormal));
+				}
+				// Every kernel set on one thread is the reference for itself on more threads
+				if (threads == 1) {
+					reference[i] = results[i];
+				} else {
+					identical = identical && memcmp(reference[i].data(), results[i].data(), results[i].size() * sizeof(SkinnedVertex)) == 0;
+				}
+			}
+			const bool passed = identical && maxError <= tolerance && maxNormalError <= CPU_SKINNING_NORMAL_TOLERANCE;
+			if (!passed) result = 1;
+
+			const double verticesPerSecond = numVertices * palettes.size() / (total / 1000.0);
+			if (baseline == 0.0) baseline = verticesPerSecond;
+			std::cout << "  " << kernels->mName << " threads=" << threads
+				<< " " << total / palettes.size() << " ms/frame"
+				<< " " << verticesPerSecond / 1e6 << " Mvertices/s"
+				<< " x" << verticesPerSecond / baseline
+				<< " maxError=" << maxError << " normalError=" << maxNormalError
+				<< (identical ? "" : " MISMATCH") << (passed ? "" : " FAILED") << std::endl;
+		}
+	}
+	return result;
+}
+
+// Compares AnimationSampler with every available kernel set against the scalar
+// InterpolateKeyFrames reference, for playback at 60 Hz and for random jumps.
+// Fails if any sample exceeds ANIMATION_KERNEL_VECTOR_TOLERANCE (relative to the
+// magnitude, for translations and scales) or ANIMATION_KERNEL_ROTATION_TOLERANCE.
+int VerifyKernels(const std::vector<std::string>& fileNames) {
+	constexpr float sampleRate = 60.0f;
+	int result = 0;
+
+	for (const auto kernels : GetAvailableAnimationKernels()) {
+		double maxVectorError = 0.0;
+		double maxRotationError = 0.0;
+		size_t numSamples = 0;
+
+		for (const auto& fileName : fileNames) {
+			Model model;
+			model.LoadAnimation(fileName);
+			for (const auto& animation : model.mAnimationSet->mAnimations) {
+				// Bind every track to a pseudo bone so the whole clip gets sampled
+				std::unordered_map<std::string, uint32_t> trackMappings;
+				for (const auto& track : animation->mAnimationTracks) {
+					trackMappings.emplace(track->mName, (uint32_t)trackMappings.size());
+				}
+				animation->Bind(trackMappings);
+
+				AnimationSampler sampler(*kernels);
+				AnimationPose pose;
+				pose.Resize(trackMappings.size());
+				std::vector<KeyFrameCursor> cursors(animation->mAnimationTracks.size());
+
+				const float length = animation->mDuration / (animation->mTicksPerSecond ? animation->mTicksPerSecond : 25.0f);
+				const size_t numSteps = (size_t)(length * 2.0f * sampleRate);
+				srand(0);
+				for (size_t i = 0; i < numSteps * 2; ++i) {
+					const float absoluteTime = i < numSteps ? i / sampleRate : length * 2.0f * (float)rand() / (float)RAND_MAX;
+					const float time = animation->GetAnimationTime(absoluteTime);
+					sampler.Sample(*animation, time, cursors, pose);
+					for (size_t t = 0; t < animation->mAnimationTracks.size(); ++t) {
+						const auto& track = animation->mAnimationTracks[t];
+						const auto boneIndex = animation->mTrackBones[t];
+						const auto vectorError = [](const glm::vec3& a, const glm::vec3& b) {
+							return (double)glm::length(a - b) / std::max(1.0, (double)glm::length(b));
+						};
+						const auto rotationError = [](const glm::quat& a, const glm::quat& b) {
+							// Small angle approximation, q and -q are the same rotation
+							return 2.0 * std::min((double)glm::length(a - b), (double)glm::length(a + b));
+						};
+						maxVectorError = std::max(maxVectorError, vectorError(pose.mTranslations[boneIndex], track->InterpolateTranslation(time)));
+						maxVectorError = std::max(maxVectorError, vectorError(pose.mScales[boneIndex], track->InterpolateScale(time)));
+						maxRotationError = std::max(maxRotationError, rotationError(pose.mRotations[boneIndex], track->InterpolateRotation(time)));
+						numSamples++;
+					}
+				}
+			}
+		}
+
+		const bool passed = maxVectorError <= ANIMATION_KERNEL_VECTOR_TOLERANCE && maxRotationError <= ANIMATION_KERNEL_ROTATION_TOLERANCE;
+		std::cout << kernels->mName << ": samples=" << numSamples
+			<< " maxVectorError=" << maxVectorError
+			<< " maxRotationError=" << maxRotationError
+			<< (passed ? " OK" : " FAILED") << std::endl;
+		if (!passed) result = 1;
+	}
+	return result;
+}
+
+// Vertex buffer sizes of every model in the scene as Vertex and as PackedVertex, with the
+// largest position (model units), normal (degrees) and weight error of the packed format.
+int BenchVertices(const std::string& fileName) {
+	Scene scene;
+	scene.Load(fileName);
+	scene.FinishStreaming();
+	std::unordered_set<const Model*> models;
+	size_t totalBytes = 0, totalPackedBytes = 0;
+	for (const auto& entity : scene.mEntities) {
+		const auto& model = entity->mModel;
+		if (!model || !models.insert(model.get()).second) continue;
+
+		std::unordered_set<const Mesh*> meshes;
+		size_t numVertices = 0;
+		float maxPositionError = 0.0f, maxNormalError = 0.0f, maxWeightError = 0.0f;
+		model->mRootNode->Recurse([&](ModelNode& node) {
+			for (const auto& mesh : node.mMeshes) {
+				if (!meshes.insert(mesh.get()).second) continue;
+				const auto vertices = mesh->GetVertices();
+				const auto aabb = AABB::FromVertices(vertices);
+				const auto offset = aabb.GetMin();
+				const auto scale = aabb.mHalfSize * 2.0f;
+				for (const auto& vertex : vertices) {
+					const auto unpacked = PackedVertex::Pack(vertex, offset, scale).Unpack(offset, scale);
+					maxPositionError = std::max(maxPositionError, glm::distance(vertex.mPos, unpacked.mPos));
+					if (glm::length(vertex.mNormal) > 0.0f) {
+						const float cosine = glm::clamp(glm::dot(glm::normalize(vertex.mNormal), unpacked.mNormal), -1.0f, 1.0f);
+						maxNormalError = std::max(maxNormalError, glm::degrees(std::acos(cosine)));
+					}
+					float sum = 0.0f;
+					for (size_t i = 0; i < MAX_VERTEX_WEIGHTS; ++i) sum += vertex.mBoneWeights[i];
+					for (size_t i = 0; i < MAX_VERTEX_WEIGHTS && sum > 0.0f; ++i) {
+						maxWeightError = std::max(maxWeightError, std::abs(vertex.mBoneWeights[i] / sum - unpacked.mBoneWeights[i]));
+					}
+				}
+				numVertices += vertices.size();
+			}
+		});
+		const size_t bytes = numVertices * sizeof(Vertex);
+		const size_t packedBytes = numVertices * sizeof(PackedVertex);
+		totalBytes += bytes;
+		totalPackedBytes += packedBytes;
+		std::cout << model->mName << ": vertices=" << numVertices
+			<< " bytesPerVertex=" << sizeof(Vertex) << "->" << sizeof(PackedVertex)
+			<< " vbo=" << bytes << "->" << packedBytes
+			<< " maxPositionError=" << maxPositionError
+			<< " maxNormalError=" << maxNormalError
+			<< " maxWeightError=" << maxWeightError << std::endl;
+	}
+	std::cout << "Total: vbo=" << totalBytes << "->" << totalPackedBytes << " bytes" << std::endl;
+	return 0;
+}
+
+// Simulated post-transform cache efficiency of every mesh in the scene as loaded and after
+// running MeshOptimizer on a copy, without and with overdraw ordering, and the triangle
+// count of every level of detail.
+int BenchMeshes(const std::string& fileName) {
+	Scene scene;
+	scene.Load(fileName);
+	scene.FinishStreaming();
+	std::unordered_set<const Mesh*> meshes;
+	const auto print = [](const char* name, const VertexCacheStats& stats) {
+		std::cout << " " << name << "ACMR=" << stats.mACMR << " " << name << "ATVR=" << stats.mATVR;
+	};
+	for (const auto& entity : scene.mEntities) {
+		if (!entity->mModel) continue;
+		entity->mModel->mRootNode->Recurse([&](ModelNode& node) {
+			for (const auto& mesh : node.mMeshes) {
+				if (!meshes.insert(mesh.get()).second) continue;
+				const auto vertices = mesh->GetVertices();
+				const auto indices = mesh->GetLodIndices(0);
+				std::vector<Vertex> optimizedVertices(vertices.begin(), vertices.end());
+				std::vector<uint32_t> optimized(indices.begin(), indices.end());
+				OptimizeVertexCache(optimized, vertices.size());
+				auto overdraw = optimized;
+				OptimizeOverdraw(overdraw, optimizedVertices);
+
+				std::cout << entity->mModel->mName << " " << node.mName << ": triangles=" << indices.size() / 3 << " vertices=" << vertices.size();
+				print("loaded", AnalyzeVertexCache(indices.data(), indices.size(), vertices.size()));
+				print("optimized", AnalyzeVertexCache(optimized.data(), optimized.size(), vertices.size()));
+				print("overdraw", AnalyzeVertexCache(overdraw.data(), overdraw.size(), vertices.size()));
+				std::cout << " lodTriangles=";
+				for (size_t level = 0; level < mesh->GetLodCount(); ++level) {
+					std::cout << (level ? "," : "") << mesh->GetLod(level).mNumIndices / 3;
+				}
+				std::cout << std::endl;
+			}
+		});
+	}
+	return 0;
+}
+
+int main(const int argc, const char** argv) {
+	const std::string command = argc > 1 ? argv[1] : "keyframes";
+	if (command == "keyframes") {
+		return BenchKeyFrames(GetArgs(argc, argv, 2, gDefaultAnimations));
+	}
+	if (command == "update") {
+		return BenchUpdate(argc > 2 ? argv[2] : "scene.json", argc > 3 ? atoi(argv[3]) : 1000, argc > 4 ? atoi(argv[4]) : 300);
+	}
+	if (command == "verify") {
+		return VerifyKernels(GetArgs(argc, argv, 2, gDefaultAnimations));
+	}
+	if (command == "report") {
+		return BenchReport(argc > 2 ? argv[2] : "scene.json", argc > 3 ? atoi(argv[3]) : 100, argc > 4 ? atoi(argv[4]) : 300, argc > 5 ? atoi(argv[5]) : -1);
+	}
+	if (command == "scaling") {
+		return BenchScaling(argc > 2 ? argv[2] : "scene.json", argc > 3 ? atoi(argv[3]) : 1000, argc > 4 ? atoi(argv[4]) : 100);
+	}
+	if (command == "allocations") {
+		return CheckAllocations(argc > 2 ? argv[2] : "scene.json", argc > 3 ? atoi(argv[3]) : 100, argc > 4 ? atoi(argv[4]) : 300);
+	}
+	if (command == "poses") {
+		return VerifyPoses(argc > 2 ? argv[2] : "scene.json", argc > 3 ? atoi(argv[3]) : 10, argc > 4 ? atoi(argv[4]) : 300);
+	}
+	if (command == "skinning") {
+		return VerifySkinning(argc > 2 ? argv[2] : "scene.json", argc > 3 ? atoi(argv[3]) : 4, argc > 4 ? atoi(argv[4]) : 60);
+	}
+	if (command == "cpuskinning") {
+		return BenchCpuSkinning(argc > 2 ? argv[2] : "scene.json", argc > 3 ? atoi(argv[3]) : 100, argc > 4 ? atoi(argv[4]) : 0);
+	}
+	if (command == "meshes") {
+		return BenchMeshes(argc > 2 ? argv[2] : "scene.json");
+	}
+	if (command == "vertices") {
+		return BenchVertices(argc > 2 ? argv[2] : "scene.json");
+	}
+	std::cerr << "Unknown benchmark: " << command << std::endl;
+	return 1;
+}
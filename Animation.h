@@ -1,54 +1,153 @@
 #pragma once
 
-#include "Main.h"
+#include "Core.h"
+#include "AABB.h"
+#include "DualQuat.h"
+#include "AnimationKernels.h"
+#include "AnimationCompression.h"
 
+// Key times and values live in separate arrays so searching only touches the times.
 template<typename T>
-struct KeyFrame {
-	float mTime;
-	T mValue;
-	KeyFrame(float time, T value) : mTime(time), mValue(value) {}
-};
+struct KeyFrames {
+	AlignedVector<float> mTimes;
+	AlignedVector<T> mValues;
 
-typedef KeyFrame<glm::vec3> VectorKey;
-typedef KeyFrame<glm::quat> QuatKey;
+	size_t size() const { return mTimes.size(); }
+	bool empty() const { return mTimes.empty(); }
 
-template<typename T>
-inline size_t GetKeyFrameIndex(const float time, const std::vector<T>& keys) {
-	for (size_t i = 0; i < keys.size() - 1; i++) {
-		if (time < (float)keys[i + 1].mTime) {
+	void Add(const float time, const T& value) {
+		mTimes.push_back(time);
+		mValues.push_back(value);
+	}
+};
+
+// Reference linear scan, kept around for benchmarking against the searches below.
+template<typename TTimes>
+inline size_t GetKeyFrameIndexLinear(const float time, const TTimes& times) {
+	for (size_t i = 0; i < times.size() - 1; i++) {
+		if (time < (float)times[i + 1]) {
 			return i;
 		}
 	}
 	return 0;
 }
 
+// Returns the index of the last key at or before time, clamped to [0, times.size() - 2].
+template<typename TTimes>
+inline size_t GetKeyFrameIndex(const float time, const TTimes& times) {
+	const auto it = std::upper_bound(times.begin() + 1, times.end() - 1, time);
+	return (size_t)(it - times.begin()) - 1;
+}
+
+// Same as above, but starts at the key found by the previous call. Monotonic playback
+// almost always lands on the same or the next key, when it doesn't (time wrapped or jumped)
+// we fall back to the binary search.
+template<typename TTimes>
+inline size_t GetKeyFrameIndex(const float time, const TTimes& times, size_t& cursor) {
+	const size_t last = times.size() - 2;
+	if (cursor <= last && times[cursor] <= time) {
+		if (cursor == last || time < times[cursor + 1]) {
+			return cursor;
+		}
+		if (cursor + 1 == last || time < times[cursor + 2]) {
+			return ++cursor;
+		}
+	}
+	cursor = GetKeyFrameIndex(time, times);
+	return cursor;
+}
+
+template<typename TTimes>
+inline float GetKeyFrameFactor(const float time, const TTimes& times, const size_t frameIndex) {
+	const float start = times[frameIndex];
+	const float end = times[frameIndex + 1];
+	if (end <= start) return 0.0f;
+	return glm::clamp((time - start) / (end - start), 0.0f, 1.0f);
+}
+
 template<typename TValue, typename TMixer>
-inline TValue InterpolateKeyFrames(const float time, const std::vector<KeyFrame<TValue>>& keys, TMixer mix) {
+inline TValue MixKeyFrames(const float time, const KeyFrames<TValue>& keys, const size_t frameIndex, TMixer mix) {
+	return mix(keys.mValues[frameIndex], keys.mValues[frameIndex + 1], GetKeyFrameFactor(time, keys.mTimes, frameIndex));
+}
+
+template<typename TValue, typename TMixer>
+inline TValue InterpolateKeyFrames(const float time, const KeyFrames<TValue>& keys, TMixer mix) {
 	if (keys.size() == 1) {
-		return keys[0].mValue;
-	}
-	const size_t frameIndex = GetKeyFrameIndex(time, keys);
-	const auto& currentFrame = keys[frameIndex];
-	const auto& nextFrame = keys[(frameIndex + 1) % keys.size()];
-	const float delta = (time - (float)currentFrame.mTime) / (float)(nextFrame.mTime - currentFrame.mTime);
-	const auto start = currentFrame.mValue;
-	const auto end = nextFrame.mValue;
-	return mix(start, end, delta);
+		return keys.mValues[0];
+	}
+	return MixKeyFrames(time, keys, GetKeyFrameIndex(time, keys.mTimes), mix);
 }
 
-inline glm::vec3 InterpolateKeyFrames(const float time, const std::vector<VectorKey>& keys) {
+template<typename TValue, typename TMixer>
+inline TValue InterpolateKeyFrames(const float time, const KeyFrames<TValue>& keys, size_t& cursor, TMixer mix) {
+	if (keys.size() == 1) {
+		return keys.mValues[0];
+	}
+	return MixKeyFrames(time, keys, GetKeyFrameIndex(time, keys.mTimes, cursor), mix);
+}
+
+inline glm::vec3 InterpolateKeyFrames(const float time, const KeyFrames<glm::vec3>& keys) {
 	return InterpolateKeyFrames(time, keys, [](const glm::vec3& a, const glm::vec3& b, const float t) -> glm::vec3 { return glm::mix(a, b, t); });
 }
 
-inline glm::quat InterpolateKeyFrames(const float time, const std::vector<QuatKey>& keys) {
+inline glm::quat InterpolateKeyFrames(const float time, const KeyFrames<glm::quat>& keys) {
 	return InterpolateKeyFrames(time, keys, [](const glm::quat& a, const glm::quat& b, const float t) -> glm::quat { return glm::slerp(a, b, t); });
 }
 
+inline glm::vec3 InterpolateKeyFrames(const float time, const KeyFrames<glm::vec3>& keys, size_t& cursor) {
+	return InterpolateKeyFrames(time, keys, cursor, [](const glm::vec3& a, const glm::vec3& b, const float t) -> glm::vec3 { return glm::mix(a, b, t); });
+}
+
+inline glm::quat InterpolateKeyFrames(const float time, const KeyFrames<glm::quat>& keys, size_t& cursor) {
+	return InterpolateKeyFrames(time, keys, cursor, [](const glm::quat& a, const glm::quat& b, const float t) -> glm::quat { return glm::slerp(a, b, t); });
+}
+
+// Last key used per channel of one track, owned by whoever plays the track.
+struct KeyFrameCursor {
+	size_t mPosition = 0;
+	size_t mRotation = 0;
+	size_t mScaling = 0;
+};
+
+template<typename T>
+inline void StoreLane(SampleBatch& batch, const size_t lane, const float factor, const T& from, const T& to) {
+	batch.mFactors[lane] = factor;
+	for (int c = 0; c < T::length(); ++c) {
+		batch.mFrom[c][lane] = from[c];
+		batch.mTo[c][lane] = to[c];
+	}
+}
+
+// Writes the two keys surrounding time and the factor between them into one lane of the batch.
+template<typename T>
+inline void GatherKeyFrames(SampleBatch& batch, const size_t lane, const float time, const KeyFrames<T>& keys, size_t& cursor) {
+	if (keys.size() == 1) {
+		StoreLane(batch, lane, 0.0f, keys.mValues[0], keys.mValues[0]);
+		return;
+	}
+	const size_t frameIndex = GetKeyFrameIndex(time, keys.mTimes, cursor);
+	StoreLane(batch, lane, GetKeyFrameFactor(time, keys.mTimes, frameIndex), keys.mValues[frameIndex], keys.mValues[frameIndex + 1]);
+}
+
+// Same as GatherKeyFrames for a compressed channel, only the two keys used are decoded.
+template<typename TDecoder>
+inline void GatherCompressedKeyFrames(SampleBatch& batch, const size_t lane, const float time, const CompressedAnimation& compressed, const CompressedChannel& channel, size_t& cursor, TDecoder decode) {
+	if (channel.mCount == 1) {
+		const auto value = decode(0);
+		StoreLane(batch, lane, 0.0f, value, value);
+		return;
+	}
+	const auto times = compressed.GetTimes(channel);
+	const float units = time * compressed.mTimeScale;
+	const size_t frameIndex = GetKeyFrameIndex(units, times, cursor);
+	StoreLane(batch, lane, GetKeyFrameFactor(units, times, frameIndex), decode(frameIndex), decode(frameIndex + 1));
+}
+
 struct AnimationTrack {
 	std::string mName;
-	std::vector<VectorKey> mPositionKeys;
-	std::vector<QuatKey> mRotationKeys;
-	std::vector<VectorKey> mScalingKeys;
+	KeyFrames<glm::vec3> mPositionKeys;
+	KeyFrames<glm::quat> mRotationKeys;
+	KeyFrames<glm::vec3> mScalingKeys;
 	// TODO: aiAnimNode aiAnimBehaviour mPreState;
 	// TODO: aiAnimNode aiAnimBehaviour mPostState;
 
@@ -61,6 +160,15 @@ struct AnimationTrack {
 	glm::vec3 InterpolateScale(const float time) const {
 		return InterpolateKeyFrames(time, mScalingKeys);
 	}
+	glm::vec3 InterpolateTranslation(const float time, KeyFrameCursor& cursor) const {
+		return InterpolateKeyFrames(time, mPositionKeys, cursor.mPosition);
+	}
+	glm::quat InterpolateRotation(const float time, KeyFrameCursor& cursor) const {
+		return InterpolateKeyFrames(time, mRotationKeys, cursor.mRotation);
+	}
+	glm::vec3 InterpolateScale(const float time, KeyFrameCursor& cursor) const {
+		return InterpolateKeyFrames(time, mScalingKeys, cursor.mScaling);
+	}
 };
 typedef std::shared_ptr<AnimationTrack> AnimationTrack_;
 
@@ -70,27 +178,61 @@ struct AnimationNode {
 	std::vector<AnimationNode_> mChildren;
 	AnimationNode_ mParent;
 	glm::mat4 mTransform;
-	uint32_t mCachedBoneIndex = -2; // FIXME!
 
 	AnimationNode(const std::string& name, AnimationNode_ parent, const glm::mat4& transform) : mName(name), mParent(parent), mTransform(transform) {
 	}
 };
 typedef AnimationNode::AnimationNode_ AnimationNode_;
 
+// Flattened AnimationNode, see AnimationSet::mJoints.
+struct AnimationJoint {
+	int32_t mParent; // Index into mJoints, -1 for roots
+	uint32_t mBoneIndex;
+	Affine mTransform; // Bind transform, used when no animation drives the bone
+};
+
 struct Animation {
 	std::string mName;
 	std::vector<AnimationTrack_> mAnimationTracks;
+	std::vector<uint32_t> mBoneTracks; // Track index per bone, -1 if the bone isn't animated
+	std::vector<uint32_t> mTrackBones; // Bone index per track, -1 if the track has no bone
+	std::vector<uint32_t> mBoundTracks; // Tracks that drive a bone, in track order
 	float mTicksPerSecond = 0;
 	float mDuration = 0;
+	CompressedAnimation_ mCompressed; // Replaces the track keys when set
 
 	// TODO: Map by Name
 	AnimationTrack_ GetAnimationTrack(const std::string& name) const {
-		for(const auto& track : mAnimationTracks) {
-			if(track->mName == name) {
-				return track;
+		const auto trackIndex = GetAnimationTrackIndex(name);
+		return trackIndex != -1 ? mAnimationTracks[trackIndex] : nullptr;
+	}
+
+	size_t GetAnimationTrackIndex(const std::string& name) const {
+		for(size_t i = 0; i < mAnimationTracks.size(); ++i) {
+			if(mAnimationTracks[i]->mName == name) {
+				return i;
+			}
+		}
+		return -1;
+	}
+
+	// Resolves tracks to bone indices so playback never has to look them up by name.
+	void Bind(const std::unordered_map<std::string, uint32_t>& boneMappings) {
+		mBoneTracks.assign(boneMappings.size(), -1);
+		mTrackBones.assign(mAnimationTracks.size(), -1);
+		mBoundTracks.clear();
+		for(size_t i = 0; i < mAnimationTracks.size(); ++i) {
+			const auto it = boneMappings.find(mAnimationTracks[i]->mName);
+			if(it != boneMappings.end()) {
+				mBoneTracks[it->second] = i;
+				mTrackBones[i] = it->second;
+				mBoundTracks.push_back(i);
 			}
 		}
-		return nullptr;
+	}
+
+	bool IsBound(const size_t numBones) const {
+		return mBoneTracks.size() == numBones;
 	}
 
 	float GetAnimationTime(const float time) {
@@ -101,25 +243,140 @@ struct Animation {
 };
 typedef std::shared_ptr<Animation> Animation_;
 
+// Local bone transforms sampled from one animation, indexed by bone.
+struct AnimationPose {
+	std::vector<glm::vec3> mTranslations;
+	std::vector<glm::quat> mRotations;
+	std::vector<glm::vec3> mScales;
+
+	void Resize(const size_t numBones) {
+		mTranslations.resize(numBones);
+		mRotations.resize(numBones);
+		mScales.resize(numBones);
+	}
+};
+
+// Samples every bound track of an animation in one go, one channel type per kernel call.
+struct AnimationSampler {
+	const AnimationKernels* mKernels;
+	SampleBatch mBatch;
+
+	AnimationSampler() : mKernels(&GetAnimationKernels()) {}
+	AnimationSampler(const AnimationKernels& kernels) : mKernels(&kernels) {}
+
+	// Sizes the batch for animations of up to numTracks tracks, so sampling them never allocates.
+	void Reserve(const size_t numTracks) {
+		mBatch.Resize(numTracks);
+	}
+
+	void Sample(const Animation& animation, const float time, std::vector<KeyFrameCursor>& cursors, AnimationPose& pose) {
+		if(animation.mCompressed) {
+			SampleCompressed(animation, *animation.mCompressed, time, cursors, pose);
+		} else {
+			SampleKeyFrames(animation, time, cursors, pose);
+		}
+	}
+
+	void SampleKeyFrames(const Animation& animation, const float time, std::vector<KeyFrameCursor>& cursors, AnimationPose& pose) {
+		const auto& tracks = animation.mAnimationTracks;
+		SampleChannels(animation, pose, [&](const size_t lane, const size_t trackIndex) {
+			GatherKeyFrames(mBatch, lane, time, tracks[trackIndex]->mPositionKeys, cursors[trackIndex].mPosition);
+		}, [&](const size_t lane, const size_t trackIndex) {
+			GatherKeyFrames(mBatch, lane, time, tracks[trackIndex]->mRotationKeys, cursors[trackIndex].mRotation);
+		}, [&](const size_t lane, const size_t trackIndex) {
+			GatherKeyFrames(mBatch, lane, time, tracks[trackIndex]->mScalingKeys, cursors[trackIndex].mScaling);
+		});
+	}
+
+	void SampleCompressed(const Animation& animation, const CompressedAnimation& compressed, const float time, std::vector<KeyFrameCursor>& cursors, AnimationPose& pose) {
+		const auto& tracks = compressed.mTracks;
+		SampleChannels(animation, pose, [&](const size_t lane, const size_t trackIndex) {
+			const auto& channel = tracks[trackIndex].mPosition;
+			GatherCompressedKeyFrames(mBatch, lane, time, compressed, channel, cursors[trackIndex].mPosition, [&](const size_t key) { return compressed.DecodeVector(channel, key); });
+		}, [&](const size_t lane, const size_t trackIndex) {
+			const auto& channel = tracks[trackIndex].mRotation;
+			GatherCompressedKeyFrames(mBatch, lane, time, compressed, channel, cursors[trackIndex].mRotation, [&](const size_t key) { return compressed.DecodeRotation(channel, key); });
+		}, [&](const size_t lane, const size_t trackIndex) {
+			const auto& channel = tracks[trackIndex].mScaling;
+			GatherCompressedKeyFrames(mBatch, lane, time, compressed, channel, cursors[trackIndex].mScaling, [&](const size_t key) { return compressed.DecodeVector(channel, key); });
+		});
+	}
+
+protected:
+	template<typename TGatherPosition, typename TGatherRotation, typename TGatherScaling>
+	void SampleChannels(const Animation& animation, AnimationPose& pose, TGatherPosition gatherPosition, TGatherRotation gatherRotation, TGatherScaling gatherScaling) {
+		const auto& laneTracks = animation.mBoundTracks;
+		const size_t numLanes = laneTracks.size();
+		mBatch.Resize(numLanes);
+
+		for(size_t lane = 0; lane < numLanes; ++lane) gatherPosition(lane, laneTracks[lane]);
+		mKernels->mLerp3(mBatch);
+		for(size_t lane = 0; lane < numLanes; ++lane) {
+			const auto boneIndex = animation.mTrackBones[laneTracks[lane]];
+			pose.mTranslations[boneIndex] = { mBatch.mResult[0][lane], mBatch.mResult[1][lane], mBatch.mResult[2][lane] };
+		}
+
+		for(size_t lane = 0; lane < numLanes; ++lane) gatherScaling(lane, laneTracks[lane]);
+		mKernels->mLerp3(mBatch);
+		for(size_t lane = 0; lane < numLanes; ++lane) {
+			const auto boneIndex = animation.mTrackBones[laneTracks[lane]];
+			pose.mScales[boneIndex] = { mBatch.mResult[0][lane], mBatch.mResult[1][lane], mBatch.mResult[2][lane] };
+		}
+
+		for(size_t lane = 0; lane < numLanes; ++lane) gatherRotation(lane, laneTracks[lane]);
+		mKernels->mNlerp4(mBatch);
+		for(size_t lane = 0; lane < numLanes; ++lane) {
+			const auto boneIndex = animation.mTrackBones[laneTracks[lane]];
+			pose.mRotations[boneIndex] = glm::quat(mBatch.mResult[3][lane], mBatch.mResult[0][lane], mBatch.mResult[1][lane], mBatch.mResult[2][lane]);
+		}
+	}
+};
+
 struct AnimationSet {
 	std::vector<Animation_> mAnimations;
+	std::unordered_map<std::string, size_t> mAnimationIndices;
 	std::unordered_map<std::string, uint32_t> mBoneMappings;
 	std::vector<glm::mat4> mBoneOffsets;
+	std::vector<Affine> mAffineBoneOffsets; // mBoneOffsets as of the last Bind
+	std::vector<AnimationJoint> mJoints; // Bone nodes of mRootNode, parents before children
 	AnimationNode_ mRootNode;
+	size_t mBoundBones = -1;
 
-	size_t GetAnimationIndex(const std::string& name) const {
-		for(size_t i = 0; i < mAnimations.size(); ++i) {
-			if(mAnimations[i]->mName == name) {
-				return i;
-			}
+	void AddAnimation(Animation_ animation) {
+		mAnimationIndices.emplace(animation->mName, mAnimations.size());
+		mAnimations.push_back(animation);
+	}
+
+	void ClearAnimations() {
+		mAnimations.clear();
+		mAnimationIndices.clear();
+	}
+
+	// Must be called whenever bones or animations are added.
+	void Bind() {
+		BuildJoints();
+		mAffineBoneOffsets.clear();
+		for(const auto& boneOffset : mBoneOffsets) {
+			mAffineBoneOffsets.push_back(Affine::FromMat4(boneOffset));
 		}
-		return -1;
+		for(auto& animation : mAnimations) {
+			animation->Bind(mBoneMappings);
+		}
+		mBoundBones = mBoneMappings.size();
 	}
 
-	uint32_t GetBoneIndex(AnimationNode_ node) const {
-		if(node->mCachedBoneIndex != -2) return node->mCachedBoneIndex;
-		node->mCachedBoneIndex = GetBoneIndex(node->mName);
-		return node->mCachedBoneIndex;
+	bool IsBound() const {
+		if(mBoundBones != mBoneMappings.size() || mAffineBoneOffsets.size() != mBoneOffsets.size()) return false;
+		for(const auto& animation : mAnimations) {
+			if(!animation->IsBound(mBoneMappings.size())) return false;
+		}
+		return true;
+	}
+
+	size_t GetAnimationIndex(const std::string& name) const {
+		const auto it = mAnimationIndices.find(name);
+		if(it == mAnimationIndices.end()) return -1;
+		return it->second;
 	}
 
 	uint32_t GetBoneIndex(const std::string& name) const {
@@ -140,29 +397,125 @@ struct AnimationSet {
 		//std::cout << "Bone " << name << " mapped to " << id << std::endl;
 		return id;
 	}
+
+protected:
+	// Nodes without a bone don't contribute a transform, their children attach to the closest bone above.
+	void BuildJoints() {
+		mJoints.clear();
+		if(!mRootNode) return;
+		std::vector<std::pair<AnimationNode*, int32_t>> stack = { { mRootNode.get(), -1 } };
+		while(!stack.empty()) {
+			const auto [node, parent] = stack.back();
+			stack.pop_back();
+			int32_t jointIndex = parent;
+			const auto boneIndex = GetBoneIndex(node->mName);
+			if(boneIndex != -1) {
+				jointIndex = (int32_t)mJoints.size();
+				mJoints.push_back({ parent, boneIndex, Affine::FromMat4(node->mTransform) });
+			}
+			for(auto it = node->mChildren.rbegin(); it != node->mChildren.rend(); ++it) {
+				stack.push_back({ it->get(), jointIndex });
+			}
+		}
+	}
 };
 typedef std::shared_ptr<AnimationSet> AnimationSet_;
 
+// One bit per bone.
+struct BoneMask {
+	std::vector<uint64_t> mBits;
+	size_t mCount = 0; // Number of set bits
+
+	void Resize(const size_t numBones) {
+		mBits.assign((numBones + 63) / 64, 0);
+		mCount = 0;
+	}
+
+	bool Test(const size_t index) const {
+		return (mBits[index >> 6] >> (index & 63)) & 1;
+	}
+
+	void Set(const size_t index, const bool value) {
+		if(Test(index) == value) return;
+		mBits[index >> 6] ^= uint64_t(1) << (index & 63);
+		mCount += value ? 1 : -1;
+	}
+
+	void Toggle(const size_t index) {
+		Set(index, !Test(index));
+	}
+
+	bool Any() const {
+		return mCount > 0;
+	}
+};
+
+struct ActiveAnimation {
+	size_t mIndex;
+	float mWeight; // As set by the user
+	float mNormalizedWeight; // Relative to all active animations
+};
+
+enum class SkinningMode {
+	Linear, // Blends mFinalTransforms
+	DualQuaternion, // Blends mDualQuaternions, see DualQuat
+};
+
+// Update doesn't allocate once the controller is constructed, everything per frame lives in
+// buffers sized up front. Every clip of at least mMinWeight is blended, in index order.
 struct AnimationController {
 	AnimationSet_ mAnimationSet;
-	std::unordered_map<size_t, float> mAnimationWeights;
-	std::unordered_map<size_t, std::unordered_map<size_t, bool>> mDisabledBones; // FIXME: Experimental
-	std::vector<glm::mat4> mFinalTransforms;
-	glm::mat4 mGlobalInverseTransform;
+	std::vector<float> mAnimationWeights; // Per animation
+	std::vector<BoneMask> mDisabledBones; // Per animation, FIXME: Experimental
+	std::vector<Affine> mFinalTransforms; // Bone palette, mGlobalInverseTransform * joint * bone offset
+	std::vector<DualQuat> mDualQuaternions; // mFinalTransforms as dual quaternions, only updated for SkinningMode::DualQuaternion
+	SkinningMode mSkinning = SkinningMode::Linear;
+	std::vector<std::vector<KeyFrameCursor>> mKeyFrameCursors; // [animation][track]
+	std::vector<Affine> mJointTransforms; // Model space transform per AnimationSet::mJoints, kept from the last Update
+	std::vector<AnimationPose> mPoses; // Last sampled pose per animation
+	std::vector<ActiveAnimation> mActiveAnimations; // Room for every animation, the first mNumActiveAnimations are used
+	size_t mNumActiveAnimations = 0;
+	bool mHasDisabledBones = false; // Any active animation has disabled bones
+	AnimationSampler mSampler;
+	Affine mGlobalInverseTransform;
 	const float mMinWeight = 0.005f;
 
 	AnimationController(AnimationSet_ animationSet, const glm::mat4& globalInverseTransform) {
 		mAnimationSet = animationSet;
-		mGlobalInverseTransform = globalInverseTransform;
+		mGlobalInverseTransform = Affine::FromMat4(globalInverseTransform);
+		if(!mAnimationSet->IsBound()) {
+			mAnimationSet->Bind();
+		}
+		const size_t numAnimations = mAnimationSet->mAnimations.size();
+		const size_t numBones = mAnimationSet->mBoneMappings.size();
+		mAnimationWeights.assign(numAnimations, 0.0f);
+		mDisabledBones.resize(numAnimations);
+		mKeyFrameCursors.resize(numAnimations);
+		mPoses.resize(numAnimations);
+		mActiveAnimations.resize(numAnimations);
+		size_t maxTracks = 0;
+		for(size_t i = 0; i < numAnimations; ++i) {
+			const size_t numTracks = mAnimationSet->mAnimations[i]->mAnimationTracks.size();
+			mDisabledBones[i].Resize(numBones);
+			mKeyFrameCursors[i].resize(numTracks);
+			mPoses[i].Resize(numBones);
+			maxTracks = std::max(maxTracks, numTracks);
+		}
+		mSampler.Reserve(maxTracks);
+		mFinalTransforms.resize(numBones);
+		mDualQuaternions.resize(numBones);
+		mJointTransforms.resize(mAnimationSet->mJoints.size());
 	}
 
 	void SetAnimationIndex(size_t animationIndex) {
-		mAnimationWeights.clear();
-		mAnimationWeights[animationIndex] = 1.0f;
+		std::fill(mAnimationWeights.begin(), mAnimationWeights.end(), 0.0f);
+		SetAnimationWeight(animationIndex, 1.0f);
 	}
 
 	void SetAnimationWeight(size_t animationIndex, float weight) {
-		mAnimationWeights[animationIndex] = weight;
+		if(animationIndex < mAnimationWeights.size()) {
+			mAnimationWeights[animationIndex] = weight;
+		}
 	}
 
 	size_t GetAnimationCount() const {
@@ -170,76 +523,135 @@ struct AnimationController {
 	}
 
 	void Update(float absoluteTime) {
-		mFinalTransforms.resize(mAnimationSet->mBoneMappings.size()); // FIXME
-		BlendNodeHierarchy(mFinalTransforms, absoluteTime);
+		BlendJoints(mFinalTransforms, absoluteTime);
+		if(mSkinning == SkinningMode::DualQuaternion) UpdateDualQuaternions();
 	}
 
-	void BlendNodeHierarchy(std::vector<glm::mat4>& outputTransforms, float absoluteTime) {
-		BlendNodeHierarchy(outputTransforms, absoluteTime, mAnimationSet->mRootNode, glm::identity<glm::mat4>());
+	// Switching takes effect immediately, the palette of the last Update is converted.
+	void SetSkinning(const SkinningMode skinning) {
+		mSkinning = skinning;
+		if(mSkinning == SkinningMode::DualQuaternion) UpdateDualQuaternions();
 	}
 
-	void BlendNodeHierarchy(std::vector<glm::mat4>& outputTransforms, const float absoluteTime, const AnimationNode_ node, const glm::mat4 parentTransform) {
-		BlendNodeHierarchy([&](auto boneIndex, const auto& combinedTransform, const auto& parentTransform, const auto& outputTransform) {
-			outputTransforms[boneIndex] = mGlobalInverseTransform * outputTransform;
-		}, absoluteTime, node, parentTransform);
+	void UpdateDualQuaternions() {
+		for(size_t i = 0; i < mFinalTransforms.size(); ++i) {
+			mDualQuaternions[i] = DualQuat::FromAffine(mFinalTransforms[i]);
+		}
 	}
 
-	void BlendNodeHierarchy(std::function<void(uint32_t, const glm::mat4&, const glm::mat4&, const glm::mat4&)> callback, const float absoluteTime) {
-		BlendNodeHierarchy(callback, absoluteTime, mAnimationSet->mRootNode, glm::identity<glm::mat4>());
+	// The pose of the last Update, for debug drawing, picking and bounds without blending again.
+	// Indexed like AnimationSet::mJoints, parents come before their children.
+	Span<const Affine> GetJointTransforms() const {
+		return { mJointTransforms.data(), mJointTransforms.size() };
 	}
 
-	void BlendNodeHierarchy(std::function<void(uint32_t, const glm::mat4&, const glm::mat4&, const glm::mat4&)> callback, const float absoluteTime, const AnimationNode_ node, const glm::mat4 parentTransform) {
-		const auto boneIndex = mAnimationSet->GetBoneIndex(node);
-		auto combinedTransform = parentTransform;
-
-		if(boneIndex != -1) {
-			const auto nodeTransform = BlendNode(boneIndex, absoluteTime, node);
-			combinedTransform *= nodeTransform;
-			callback(boneIndex, combinedTransform, parentTransform, combinedTransform * mAnimationSet->mBoneOffsets[boneIndex]);
-		}
+	int32_t GetJointParent(const size_t joint) const {
+		return mAnimationSet->mJoints[joint].mParent;
+	}
 
-		for(auto& childNode : node->mChildren) {
-			BlendNodeHierarchy(callback, absoluteTime, childNode, combinedTransform);
+	// Model space bounds of the joint positions of the last Update.
+	AABB GetJointBounds() const {
+		if(mJointTransforms.empty()) return AABB();
+		const auto first = mJointTransforms[0].GetTranslation();
+		auto bounds = AABB::FromExtents(first, first);
+		for(const auto& transform : mJointTransforms) {
+			bounds = bounds.Extend(transform.GetTranslation());
 		}
+		return bounds;
 	}
 
-	glm::mat4 BlendNode(const size_t boneIndex, const float absoluteTime, const AnimationNode_ node) {
-		const auto weights = GetNormalizedWeights(boneIndex);
-		if(weights.empty()) return node->mTransform;
+	void BlendJoints(std::vector<Affine>& outputTransforms, const float absoluteTime) {
+		BlendJoints([&](const auto& joint, const auto& combinedTransform, const auto& parentTransform, const auto& outputTransform) {
+			outputTransforms[joint.mBoneIndex] = mGlobalInverseTransform * outputTransform;
+		}, absoluteTime);
+	}
 
-		glm::vec3 translation = { 0, 0, 0 };
-		glm::quat rotation = glm::identity<glm::quat>();
-		glm::vec3 scale = { 0, 0, 0 };
+	// Evaluates mAnimationSet->mJoints in order, callback(joint, combinedTransform, parentTransform, outputTransform)
+	template<typename TCallback>
+	void BlendJoints(TCallback callback, const float absoluteTime) {
+		SampleAnimations(absoluteTime);
+		const auto& joints = mAnimationSet->mJoints;
+		const auto& boneOffsets = mAnimationSet->mAffineBoneOffsets;
+		const Affine identity;
+		for(size_t i = 0; i < joints.size(); ++i) {
+			const auto& joint = joints[i];
+			const auto& parentTransform = joint.mParent < 0 ? identity : mJointTransforms[joint.mParent];
+			auto& combinedTransform = mJointTransforms[i];
+			combinedTransform = parentTransform * BlendJoint(joint);
+			callback(joint, combinedTransform, parentTransform, combinedTransform * boneOffsets[joint.mBoneIndex]);
+		}
+	}
 
-		for(auto& [k, animationWeight] : weights) {
-			auto& animation = mAnimationSet->mAnimations[k];
-			const auto animationTime = animation->GetAnimationTime(absoluteTime);
-			auto track = animation->GetAnimationTrack(node->mName);
-			if(track == nullptr) continue; // node->mTransform?????? FIXME!
-			translation += track->InterpolateTranslation(animationTime) * animationWeight;
-			rotation *= glm::slerp(glm::identity<glm::quat>(), track->InterpolateRotation(animationTime), animationWeight);
-			scale += track->InterpolateScale(animationTime) * animationWeight;
+	// Collects and normalizes the weights of this frame and samples each active animation once.
+	void SampleAnimations(const float absoluteTime) {
+		mNumActiveAnimations = 0;
+		mHasDisabledBones = false;
+		float totalWeight = 0.0f;
+		for(size_t k = 0; k < mAnimationWeights.size(); ++k) {
+			const float w = mAnimationWeights[k];
+			if(w < mMinWeight) continue;
+			mActiveAnimations[mNumActiveAnimations++] = { k, w, 0.0f };
+			mHasDisabledBones |= mDisabledBones[k].Any();
+			totalWeight += w;
 		}
+		for(size_t i = 0; i < mNumActiveAnimations; ++i) {
+			auto& active = mActiveAnimations[i];
+			active.mNormalizedWeight = active.mWeight / totalWeight;
+			auto& animation = mAnimationSet->mAnimations[active.mIndex];
+			mSampler.Sample(*animation, animation->GetAnimationTime(absoluteTime), mKeyFrameCursors[active.mIndex], mPoses[active.mIndex]);
+		}
+	}
 
-		auto nodeTransform = glm::translate(glm::identity<glm::mat4>(), translation);
-		nodeTransform *= glm::mat4_cast(rotation);
-		nodeTransform = glm::scale(nodeTransform, scale);
+	Affine BlendJoint(const AnimationJoint& joint) {
+		glm::vec3 translation, scale;
+		glm::quat rotation;
+		if(!BlendJoint(joint, translation, rotation, scale)) return joint.mTransform;
+		return Affine::FromTRS(translation, rotation, scale);
+	}
 
-		return nodeTransform;
+	// Blended local translation, rotation and scale of the sampled poses, false if no
+	// animation affects the joint and it keeps its bind transform.
+	bool BlendJoint(const AnimationJoint& joint, glm::vec3& translation, glm::quat& rotation, glm::vec3& scale) const {
+		const auto boneIndex = joint.mBoneIndex;
+		const float totalWeight = GetTotalWeight(boneIndex);
+		if(totalWeight <= 0.0f) return false;
+
+		translation = { 0, 0, 0 };
+		rotation = glm::identity<glm::quat>();
+		scale = { 0, 0, 0 };
+
+		for(size_t i = 0; i < mNumActiveAnimations; ++i) {
+			const float animationWeight = GetNormalizedWeight(i, boneIndex, totalWeight);
+			if(animationWeight <= 0.0f) continue;
+			const auto k = mActiveAnimations[i].mIndex;
+			const auto& animation = mAnimationSet->mAnimations[k];
+			if(animation->mBoneTracks[boneIndex] == -1) continue; // node->mTransform?????? FIXME!
+			const auto& pose = mPoses[k];
+			translation += pose.mTranslations[boneIndex] * animationWeight;
+			rotation *= glm::slerp(glm::identity<glm::quat>(), pose.mRotations[boneIndex], animationWeight);
+			scale += pose.mScales[boneIndex] * animationWeight;
+		}
+		return true;
 	}
 
 protected:
-	std::unordered_map<size_t, float> GetNormalizedWeights(const size_t boneIndex) {
-		std::unordered_map<size_t, float> result;
+	// Summed weight of the active animations that don't disable the bone, 0 if none affects it.
+	// Only bones disabled in some active animation need to be renormalized.
+	float GetTotalWeight(const size_t boneIndex) const {
+		if(!mHasDisabledBones) return mNumActiveAnimations > 0 ? 1.0f : 0.0f;
 		float totalWeight = 0.0f;
-		for(auto& [k, w] : mAnimationWeights) {
-			if(w < mMinWeight) continue;
-			if(mDisabledBones[k][boneIndex]) continue;
-			totalWeight += w;
-			result[k] = w;
+		for(size_t i = 0; i < mNumActiveAnimations; ++i) {
+			const auto& active = mActiveAnimations[i];
+			if(!mDisabledBones[active.mIndex].Test(boneIndex)) totalWeight += active.mWeight;
 		}
-		for(auto& [k, w] : result) result[k] /= totalWeight;
-		return result;
+		return totalWeight;
+	}
+
+	// Weight of active animation i for the bone, totalWeight from GetTotalWeight.
+	float GetNormalizedWeight(const size_t i, const size_t boneIndex, const float totalWeight) const {
+		const auto& active = mActiveAnimations[i];
+		if(!mHasDisabledBones) return active.mNormalizedWeight;
+		return mDisabledBones[active.mIndex].Test(boneIndex) ? 0.0f : active.mWeight / totalWeight;
 	}
 };
 typedef std::shared_ptr<AnimationController> AnimationController_;
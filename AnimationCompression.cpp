@@ -0,0 +1,137 @@
+#include "AnimationCompression.h"
+#include "Animation.h"
+
+template<typename T>
+void CompressTimes(CompressedAnimation& compressed, CompressedChannel& channel, const KeyFrames<T>& keys) {
+	channel.mTimeOffset = (uint32_t)compressed.mTimes.size();
+	channel.mCount = (uint32_t)keys.size();
+	for (const auto time : keys.mTimes) {
+		const float units = glm::clamp(time * compressed.mTimeScale, 0.0f, COMPRESSED_TIME_MAX);
+		compressed.mTimes.push_back((uint16_t)std::lround(units));
+	}
+}
+
+void CompressVectors(CompressedAnimation& compressed, CompressedVectorChannel& channel, const KeyFrames<glm::vec3>& keys) {
+	CompressTimes(compressed, channel, keys);
+	channel.mValueOffset = (uint32_t)(compressed.mVectors.size() / 3);
+	if (keys.empty()) return;
+
+	glm::vec3 min = keys.mValues[0];
+	glm::vec3 max = keys.mValues[0];
+	for (const auto& value : keys.mValues) {
+		min = glm::min(min, value);
+		max = glm::max(max, value);
+	}
+	channel.mMin = min;
+	channel.mStep = (max - min) / COMPRESSED_VECTOR_MAX;
+
+	for (const auto& value : keys.mValues) {
+		for (int c = 0; c < 3; ++c) {
+			const float q = channel.mStep[c] > 0.0f ? (value[c] - min[c]) / channel.mStep[c] : 0.0f;
+			compressed.mVectors.push_back((uint16_t)std::lround(glm::clamp(q, 0.0f, COMPRESSED_VECTOR_MAX)));
+		}
+	}
+}
+
+void CompressRotations(CompressedAnimation& compressed, CompressedChannel& channel, const KeyFrames<glm::quat>& keys) {
+	CompressTimes(compressed, channel, keys);
+	channel.mValueOffset = (uint32_t)(compressed.mRotations.size() / 3);
+
+	for (const auto& value : keys.mValues) {
+		auto q = glm::normalize(value);
+		uint32_t largest = 0;
+		for (uint32_t c = 1; c < 4; ++c) {
+			if (std::abs(q[c]) > std::abs(q[largest])) largest = c;
+		}
+		if (q[largest] < 0.0f) q = -q;
+
+		uint16_t packed[3];
+		for (uint32_t c = 0, i = 0; c < 4; ++c) {
+			if (c == largest) continue;
+			const float normalized = glm::clamp(q[c] / COMPRESSED_ROTATION_RANGE * 0.5f + 0.5f, 0.0f, 1.0f);
+			packed[i++] = (uint16_t)std::lround(normalized * COMPRESSED_ROTATION_MAX);
+		}
+		packed[0] |= (uint16_t)((largest & 1) << 15);
+		packed[1] |= (uint16_t)((largest >> 1) << 15);
+		compressed.mRotations.insert(compressed.mRotations.end(), packed, packed + 3);
+	}
+}
+
+template<typename T>
+size_t GetKeyFramesByteSize(const KeyFrames<T>& keys) {
+	return keys.mTimes.size() * sizeof(float) + keys.mValues.size() * sizeof(T);
+}
+
+CompressedAnimation_ CompressAnimation(const Animation& animation) {
+	auto compressed = std::make_shared<CompressedAnimation>();
+	compressed->mTimeScale = animation.mDuration > 0.0f ? COMPRESSED_TIME_MAX / animation.mDuration : 0.0f;
+	compressed->mTracks.resize(animation.mAnimationTracks.size());
+	for (size_t i = 0; i < animation.mAnimationTracks.size(); ++i) {
+		const auto& track = animation.mAnimationTracks[i];
+		auto& compressedTrack = compressed->mTracks[i];
+		CompressVectors(*compressed, compressedTrack.mPosition, track->mPositionKeys);
+		CompressRotations(*compressed, compressedTrack.mRotation, track->mRotationKeys);
+		CompressVectors(*compressed, compressedTrack.mScaling, track->mScalingKeys);
+		compressed->mStats.mBytesBefore += sizeof(AnimationTrack)
+			+ GetKeyFramesByteSize(track->mPositionKeys)
+			+ GetKeyFramesByteSize(track->mRotationKeys)
+			+ GetKeyFramesByteSize(track->mScalingKeys);
+	}
+	compressed->mStats.mBytesAfter = compressed->GetByteSize();
+	return compressed;
+}
+
+// Model space joint positions of the sampled pose, bones the animation doesn't drive keep their bind transform.
+void EvaluateJointPositions(const AnimationSet& animationSet, const Animation& animation, const AnimationPose& pose, std::vector<glm::mat4>& transforms, std::vector<glm::vec3>& positions) {
+	const auto& joints = animationSet.mJoints;
+	transforms.resize(joints.size());
+	positions.resize(joints.size());
+	for (size_t i = 0; i < joints.size(); ++i) {
+		const auto& joint = joints[i];
+		auto local = joint.mTransform.ToMat4();
+		if (animation.mBoneTracks[joint.mBoneIndex] != -1) {
+			local = glm::translate(glm::identity<glm::mat4>(), pose.mTranslations[joint.mBoneIndex]);
+			local *= glm::mat4_cast(pose.mRotations[joint.mBoneIndex]);
+			local = glm::scale(local, pose.mScales[joint.mBoneIndex]);
+		}
+		transforms[i] = joint.mParent < 0 ? local : transforms[joint.mParent] * local;
+		positions[i] = glm::vec3(transforms[i][3]);
+	}
+}
+
+CompressionStats MeasureCompression(const AnimationSet& animationSet, const Animation& animation, const CompressedAnimation& compressed) {
+	auto stats = compressed.mStats;
+	const size_t numBones = animationSet.mBoneMappings.size();
+
+	// Every key time of every track, plus the midpoints between them
+	std::vector<float> times;
+	for (const auto& track : animation.mAnimationTracks) {
+		times.insert(times.end(), track->mPositionKeys.mTimes.begin(), track->mPositionKeys.mTimes.end());
+		times.insert(times.end(), track->mRotationKeys.mTimes.begin(), track->mRotationKeys.mTimes.end());
+	}
+	std::sort(times.begin(), times.end());
+	times.erase(std::unique(times.begin(), times.end()), times.end());
+	for (size_t i = 1, n = times.size(); i < n; ++i) {
+		times.push_back((times[i - 1] + times[i]) * 0.5f);
+	}
+
+	AnimationSampler sampler;
+	AnimationPose originalPose, compressedPose;
+	originalPose.Resize(numBones);
+	compressedPose.Resize(numBones);
+	std::vector<KeyFrameCursor> originalCursors(animation.mAnimationTracks.size());
+	std::vector<KeyFrameCursor> compressedCursors(animation.mAnimationTracks.size());
+	std::vector<glm::mat4> transforms;
+	std::vector<glm::vec3> originalPositions, compressedPositions;
+
+	for (const auto time : times) {
+		sampler.SampleKeyFrames(animation, time, originalCursors, originalPose);
+		sampler.SampleCompressed(animation, compressed, time, compressedCursors, compressedPose);
+		EvaluateJointPositions(animationSet, animation, originalPose, transforms, originalPositions);
+		EvaluateJointPositions(animationSet, animation, compressedPose, transforms, compressedPositions);
+		for (size_t i = 0; i < originalPositions.size(); ++i) {
+			stats.mMaxError = std::max(stats.mMaxError, glm::distance(originalPositions[i], compressedPositions[i]));
+		}
+	}
+	return stats;
+}
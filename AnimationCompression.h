@@ -0,0 +1,91 @@
+#pragma once
+
+#include "Core.h"
+
+// Quantized storage for an Animation, sampled in place by AnimationSampler.
+//
+// Key times are 16-bit fractions of the animation duration. Translation and scale
+// keys are 16 bits per component, quantized to the value range of their channel.
+// Rotations use smallest-three: the largest component is dropped (and made positive
+// by flipping the quaternion), the other three are stored as 15 bits each in
+// [-1/sqrt(2), 1/sqrt(2)] with the index of the dropped component in the spare bits.
+
+#define COMPRESSED_TIME_MAX 65535.0f
+#define COMPRESSED_VECTOR_MAX 65535.0f
+#define COMPRESSED_ROTATION_MAX 32767.0f
+#define COMPRESSED_ROTATION_RANGE 0.70710678f
+
+struct CompressedChannel {
+	uint32_t mTimeOffset = 0; // First key in CompressedAnimation::mTimes
+	uint32_t mValueOffset = 0; // First key in mVectors or mRotations, in keys
+	uint32_t mCount = 0;
+};
+
+struct CompressedVectorChannel : CompressedChannel {
+	glm::vec3 mMin = { 0, 0, 0 };
+	glm::vec3 mStep = { 0, 0, 0 };
+};
+
+struct CompressedTrack {
+	CompressedVectorChannel mPosition;
+	CompressedChannel mRotation;
+	CompressedVectorChannel mScaling;
+};
+
+struct CompressionStats {
+	size_t mBytesBefore = 0;
+	size_t mBytesAfter = 0;
+	float mMaxError = 0.0f; // Model space distance between original and compressed joint positions
+};
+
+struct CompressedAnimation {
+	float mTimeScale = 0.0f; // Ticks to quantized time units
+	std::vector<uint16_t> mTimes;
+	std::vector<uint16_t> mVectors; // 3 per key
+	std::vector<uint16_t> mRotations; // 3 per key
+	std::vector<CompressedTrack> mTracks; // Same order as Animation::mAnimationTracks
+	CompressionStats mStats;
+
+	Span<const uint16_t> GetTimes(const CompressedChannel& channel) const {
+		return { mTimes.data() + channel.mTimeOffset, channel.mCount };
+	}
+
+	glm::vec3 DecodeVector(const CompressedVectorChannel& channel, const size_t key) const {
+		const uint16_t* v = &mVectors[(channel.mValueOffset + key) * 3];
+		return channel.mMin + glm::vec3(v[0], v[1], v[2]) * channel.mStep;
+	}
+
+	glm::quat DecodeRotation(const CompressedChannel& channel, const size_t key) const {
+		const uint16_t* v = &mRotations[(channel.mValueOffset + key) * 3];
+		const uint32_t largest = (v[0] >> 15) | ((v[1] >> 15) << 1);
+		float components[4];
+		float sum = 0.0f;
+		for (uint32_t c = 0, i = 0; c < 4; ++c) {
+			if (c == largest) continue;
+			const float value = ((v[i++] & 0x7fff) / COMPRESSED_ROTATION_MAX * 2.0f - 1.0f) * COMPRESSED_ROTATION_RANGE;
+			components[c] = value;
+			sum += value * value;
+		}
+		components[largest] = std::sqrt(std::max(0.0f, 1.0f - sum));
+		return glm::quat(components[3], components[0], components[1], components[2]);
+	}
+
+	size_t GetByteSize() const {
+		return sizeof(CompressedAnimation)
+			+ mTimes.size() * sizeof(uint16_t)
+			+ mVectors.size() * sizeof(uint16_t)
+			+ mRotations.size() * sizeof(uint16_t)
+			+ mTracks.size() * sizeof(CompressedTrack);
+	}
+};
+typedef std::shared_ptr<CompressedAnimation> CompressedAnimation_;
+
+struct Animation;
+struct AnimationSet;
+
+// Quantizes all tracks of the animation, the original keys are left untouched.
+CompressedAnimation_ CompressAnimation(const Animation& animation);
+
+// Compares the animation with and without compression by evaluating the skeleton of
+// the set at every key time, animation must be bound to the set.
+CompressionStats MeasureCompression(const AnimationSet& animationSet, const Animation& animation, const CompressedAnimation& compressed);
@@ -0,0 +1,173 @@
+#include "AnimationKernels.h"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define ANIMATION_KERNELS_X86
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define ANIMATION_TARGET_SSE2
+#define ANIMATION_TARGET_AVX
+#else
+#define ANIMATION_TARGET_SSE2 __attribute__((target("sse2")))
+#define ANIMATION_TARGET_AVX __attribute__((target("avx")))
+#endif
+#endif
+
+void Lerp3Scalar(SampleBatch& batch) {
+	for (size_t i = 0; i < batch.mCount; ++i) {
+		const float t = batch.mFactors[i];
+		for (int c = 0; c < 3; ++c) {
+			const float a = batch.mFrom[c][i];
+			batch.mResult[c][i] = a + (batch.mTo[c][i] - a) * t;
+		}
+	}
+}
+
+void Nlerp4Scalar(SampleBatch& batch) {
+	for (size_t i = 0; i < batch.mCount; ++i) {
+		const float t = batch.mFactors[i];
+		float d = 0.0f;
+		for (int c = 0; c < 4; ++c) d += batch.mFrom[c][i] * batch.mTo[c][i];
+		const float sign = d < 0.0f ? -1.0f : 1.0f;
+		float r[4];
+		float length2 = 0.0f;
+		for (int c = 0; c < 4; ++c) {
+			const float a = batch.mFrom[c][i];
+			r[c] = a + (batch.mTo[c][i] * sign - a) * t;
+			length2 += r[c] * r[c];
+		}
+		const float scale = 1.0f / std::sqrt(std::max(length2, 1e-30f));
+		for (int c = 0; c < 4; ++c) batch.mResult[c][i] = r[c] * scale;
+	}
+}
+
+#ifdef ANIMATION_KERNELS_X86
+
+ANIMATION_TARGET_SSE2 void Lerp3SSE2(SampleBatch& batch) {
+	const size_t count = batch.GetPaddedCount();
+	for (size_t i = 0; i < count; i += 4) {
+		const __m128 t = _mm_load_ps(&batch.mFactors[i]);
+		for (int c = 0; c < 3; ++c) {
+			const __m128 a = _mm_load_ps(&batch.mFrom[c][i]);
+			const __m128 b = _mm_load_ps(&batch.mTo[c][i]);
+			_mm_store_ps(&batch.mResult[c][i], _mm_add_ps(a, _mm_mul_ps(_mm_sub_ps(b, a), t)));
+		}
+	}
+}
+
+ANIMATION_TARGET_SSE2 void Nlerp4SSE2(SampleBatch& batch) {
+	const size_t count = batch.GetPaddedCount();
+	const __m128 signMask = _mm_set1_ps(-0.0f);
+	const __m128 minLength2 = _mm_set1_ps(1e-30f);
+	for (size_t i = 0; i < count; i += 4) {
+		const __m128 t = _mm_load_ps(&batch.mFactors[i]);
+		__m128 a[4], b[4];
+		__m128 d = _mm_setzero_ps();
+		for (int c = 0; c < 4; ++c) {
+			a[c] = _mm_load_ps(&batch.mFrom[c][i]);
+			b[c] = _mm_load_ps(&batch.mTo[c][i]);
+			d = _mm_add_ps(d, _mm_mul_ps(a[c], b[c]));
+		}
+		// Flip b onto the same hemisphere as a by copying the sign of the dot product
+		const __m128 sign = _mm_and_ps(d, signMask);
+		__m128 r[4];
+		__m128 length2 = _mm_setzero_ps();
+		for (int c = 0; c < 4; ++c) {
+			r[c] = _mm_add_ps(a[c], _mm_mul_ps(_mm_sub_ps(_mm_xor_ps(b[c], sign), a[c]), t));
+			length2 = _mm_add_ps(length2, _mm_mul_ps(r[c], r[c]));
+		}
+		const __m128 length = _mm_sqrt_ps(_mm_max_ps(length2, minLength2));
+		for (int c = 0; c < 4; ++c) {
+			_mm_store_ps(&batch.mResult[c][i], _mm_div_ps(r[c], length));
+		}
+	}
+}
+
+ANIMATION_TARGET_AVX void Lerp3AVX(SampleBatch& batch) {
+	const size_t count = batch.GetPaddedCount();
+	for (size_t i = 0; i < count; i += 8) {
+		const __m256 t = _mm256_load_ps(&batch.mFactors[i]);
+		for (int c = 0; c < 3; ++c) {
+			const __m256 a = _mm256_load_ps(&batch.mFrom[c][i]);
+			const __m256 b = _mm256_load_ps(&batch.mTo[c][i]);
+			_mm256_store_ps(&batch.mResult[c][i], _mm256_add_ps(a, _mm256_mul_ps(_mm256_sub_ps(b, a), t)));
+		}
+	}
+}
+
+ANIMATION_TARGET_AVX void Nlerp4AVX(SampleBatch& batch) {
+	const size_t count = batch.GetPaddedCount();
+	const __m256 signMask = _mm256_set1_ps(-0.0f);
+	const __m256 minLength2 = _mm256_set1_ps(1e-30f);
+	for (size_t i = 0; i < count; i += 8) {
+		const __m256 t = _mm256_load_ps(&batch.mFactors[i]);
+		__m256 a[4], b[4];
+		__m256 d = _mm256_setzero_ps();
+		for (int c = 0; c < 4; ++c) {
+			a[c] = _mm256_load_ps(&batch.mFrom[c][i]);
+			b[c] = _mm256_load_ps(&batch.mTo[c][i]);
+			d = _mm256_add_ps(d, _mm256_mul_ps(a[c], b[c]));
+		}
+		const __m256 sign = _mm256_and_ps(d, signMask);
+		__m256 r[4];
+		__m256 length2 = _mm256_setzero_ps();
+		for (int c = 0; c < 4; ++c) {
+			r[c] = _mm256_add_ps(a[c], _mm256_mul_ps(_mm256_sub_ps(_mm256_xor_ps(b[c], sign), a[c]), t));
+			length2 = _mm256_add_ps(length2, _mm256_mul_ps(r[c], r[c]));
+		}
+		const __m256 length = _mm256_sqrt_ps(_mm256_max_ps(length2, minLength2));
+		for (int c = 0; c < 4; ++c) {
+			_mm256_store_ps(&batch.mResult[c][i], _mm256_div_ps(r[c], length));
+		}
+	}
+}
+
+bool CpuSupportsSSE2() {
+#if defined(_MSC_VER)
+	int info[4];
+	__cpuid(info, 1);
+	return (info[3] & (1 << 26)) != 0;
+#else
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("sse2");
+#endif
+}
+
+bool CpuSupportsAVX() {
+#if defined(_MSC_VER)
+	int info[4];
+	__cpuid(info, 1);
+	const bool avx = (info[2] & (1 << 28)) != 0;
+	const bool osxsave = (info[2] & (1 << 27)) != 0;
+	// The OS also has to save the upper halves of the ymm registers
+	return avx && osxsave && (_xgetbv(0) & 6) == 6;
+#else
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx");
+#endif
+}
+
+#endif
+
+const AnimationKernels gScalarKernels = { "scalar", Lerp3Scalar, Nlerp4Scalar };
+#ifdef ANIMATION_KERNELS_X86
+const AnimationKernels gSSE2Kernels = { "sse2", Lerp3SSE2, Nlerp4SSE2 };
+const AnimationKernels gAVXKernels = { "avx", Lerp3AVX, Nlerp4AVX };
+#endif
+
+std::vector<const AnimationKernels*> GetAvailableAnimationKernels() {
+	std::vector<const AnimationKernels*> result = { &gScalarKernels };
+#ifdef ANIMATION_KERNELS_X86
+	if (CpuSupportsSSE2()) result.push_back(&gSSE2Kernels);
+	if (CpuSupportsAVX()) result.push_back(&gAVXKernels);
+#endif
+	return result;
+}
+
+const AnimationKernels& GetAnimationKernels() {
+	static const AnimationKernels* kernels = GetAvailableAnimationKernels().back();
+	return *kernels;
+}
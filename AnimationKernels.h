@@ -0,0 +1,79 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <vector>
+
+#define ANIMATION_KERNEL_ALIGNMENT 32
+#define ANIMATION_KERNEL_WIDTH 8
+
+template<typename T>
+struct AlignedAllocator {
+	typedef T value_type;
+
+	AlignedAllocator() {}
+	template<typename U> AlignedAllocator(const AlignedAllocator<U>&) {}
+
+	T* allocate(size_t n) {
+		return static_cast<T*>(::operator new(n * sizeof(T), std::align_val_t(ANIMATION_KERNEL_ALIGNMENT)));
+	}
+
+	void deallocate(T* p, size_t) {
+		::operator delete(p, std::align_val_t(ANIMATION_KERNEL_ALIGNMENT));
+	}
+
+	template<typename U> bool operator==(const AlignedAllocator<U>&) const { return true; }
+	template<typename U> bool operator!=(const AlignedAllocator<U>&) const { return false; }
+};
+
+template<typename T>
+using AlignedVector = std::vector<T, AlignedAllocator<T>>;
+
+// Structure of arrays staging area for interpolating many channels at once.
+// Lane i interpolates mFrom[c][i] towards mTo[c][i] by mFactors[i] into mResult[c][i].
+struct SampleBatch {
+	size_t mCount = 0;
+	AlignedVector<float> mFactors;
+	AlignedVector<float> mFrom[4];
+	AlignedVector<float> mTo[4];
+	AlignedVector<float> mResult[4];
+
+	// Capacity is padded to the kernel width so kernels never need a scalar tail.
+	void Resize(const size_t count) {
+		mCount = count;
+		const size_t capacity = (count + ANIMATION_KERNEL_WIDTH - 1) / ANIMATION_KERNEL_WIDTH * ANIMATION_KERNEL_WIDTH;
+		if (mFactors.size() >= capacity) return;
+		mFactors.resize(capacity, 0.0f);
+		for (int c = 0; c < 4; ++c) {
+			mFrom[c].resize(capacity, 0.0f);
+			mTo[c].resize(capacity, 0.0f);
+			mResult[c].resize(capacity, 0.0f);
+		}
+	}
+
+	size_t GetPaddedCount() const {
+		return (mCount + ANIMATION_KERNEL_WIDTH - 1) / ANIMATION_KERNEL_WIDTH * ANIMATION_KERNEL_WIDTH;
+	}
+};
+
+// Interpolation kernels for one instruction set.
+// Lerp3 linearly interpolates xyz, Nlerp4 interpolates xyzw quaternions along the
+// shortest arc and renormalizes instead of doing a true slerp.
+struct AnimationKernels {
+	const char* mName;
+	void (*mLerp3)(SampleBatch& batch);
+	void (*mNlerp4)(SampleBatch& batch);
+};
+
+// Maximum difference from the scalar InterpolateKeyFrames path (glm::mix / glm::slerp)
+// for sampled clips, checked by "AnimBench verify". Vectors are relative to their
+// length (or absolute below 1), rotations are in radians and dominated by nlerp.
+#define ANIMATION_KERNEL_VECTOR_TOLERANCE 1e-4f
+#define ANIMATION_KERNEL_ROTATION_TOLERANCE 1e-3f
+
+// Fastest kernels supported by the running CPU.
+const AnimationKernels& GetAnimationKernels();
+
+// Every kernel set supported by the running CPU, scalar first.
+std::vector<const AnimationKernels*> GetAvailableAnimationKernels();
@@ -0,0 +1,94 @@
+#include "AnimationReduction.h"
+
+// Returns the model space distance from node to its furthest descendant.
+float GetNodeTolerances(KeyFrameTolerances& tolerances, const AnimationNode& node, const glm::mat4& parentTransform, const float distance, const float angle) {
+	const auto transform = parentTransform * node.mTransform;
+	const auto position = glm::vec3(transform[3]);
+	float reach = 0.0f;
+	for (const auto& child : node.mChildren) {
+		const auto childPosition = glm::vec3((transform * child->mTransform)[3]);
+		const float childReach = GetNodeTolerances(tolerances, *child, transform, distance, angle);
+		reach = std::max(reach, glm::distance(position, childPosition) + childReach);
+	}
+
+	const float parentScale = glm::length(glm::vec3(parentTransform[0]));
+	KeyFrameTolerance tolerance;
+	tolerance.mTranslation = parentScale > 0.0f ? distance / parentScale : distance;
+	tolerance.mRotation = reach > 0.0f ? std::min(angle, distance / reach) : angle;
+	tolerance.mScale = reach > 0.0f ? distance / reach : distance;
+	tolerances[node.mName] = tolerance;
+	return reach;
+}
+
+KeyFrameTolerances GetKeyFrameTolerances(const AnimationNode_& root, const float distance, const float angle) {
+	KeyFrameTolerances tolerances;
+	if (root) {
+		GetNodeTolerances(tolerances, *root, glm::identity<glm::mat4>(), distance, angle);
+	}
+	return tolerances;
+}
+
+template<typename T, typename TMixer, typename TError>
+void ReduceChannel(KeyFrames<T>& keys, const float tolerance, ReductionStats& stats, TMixer mix, TError error) {
+	stats.mKeysBefore += keys.size();
+	if (keys.size() <= 1) {
+		stats.mKeysAfter += keys.size();
+		return;
+	}
+
+	bool constant = true;
+	for (size_t i = 1; i < keys.size() && constant; ++i) {
+		constant = error(keys.mValues[i], keys.mValues[0]) <= tolerance;
+	}
+	if (constant) {
+		keys.mTimes.resize(1);
+		keys.mValues.resize(1);
+		stats.mKeysAfter += 1;
+		stats.mConstantChannels++;
+		return;
+	}
+
+	// Greedy: extend the segment from the last kept key for as long as every key it
+	// skips can be reconstructed from its end points.
+	KeyFrames<T> result;
+	result.Add(keys.mTimes[0], keys.mValues[0]);
+	size_t start = 0;
+	for (size_t end = 2; end < keys.size(); ++end) {
+		const float startTime = keys.mTimes[start];
+		const float length = keys.mTimes[end] - startTime;
+		bool fits = true;
+		for (size_t i = start + 1; i < end && fits; ++i) {
+			const float factor = length > 0.0f ? (keys.mTimes[i] - startTime) / length : 0.0f;
+			fits = error(mix(keys.mValues[start], keys.mValues[end], factor), keys.mValues[i]) <= tolerance;
+		}
+		if (!fits) {
+			start = end - 1;
+			result.Add(keys.mTimes[start], keys.mValues[start]);
+		}
+	}
+	result.Add(keys.mTimes.back(), keys.mValues.back());
+
+	stats.mKeysAfter += result.size();
+	keys = std::move(result);
+}
+
+ReductionStats ReduceKeyFrames(Animation& animation, const KeyFrameTolerances& tolerances, const KeyFrameTolerance& fallback) {
+	const auto mixVector = [](const glm::vec3& a, const glm::vec3& b, const float t) { return glm::mix(a, b, t); };
+	const auto mixRotation = [](const glm::quat& a, const glm::quat& b, const float t) { return glm::slerp(a, b, t); };
+	const auto vectorError = [](const glm::vec3& a, const glm::vec3& b) { return glm::distance(a, b); };
+	// Rotation angle between a and b from the chord length, acos is too imprecise near 1
+	const auto rotationError = [](const glm::quat& a, const glm::quat& b) {
+		const float chord = glm::dot(a, b) < 0.0f ? glm::length(a + b) : glm::length(a - b);
+		return 4.0f * std::asin(std::min(1.0f, chord * 0.5f));
+	};
+
+	ReductionStats stats;
+	for (auto& track : animation.mAnimationTracks) {
+		const auto it = tolerances.find(track->mName);
+		const auto& tolerance = it != tolerances.end() ? it->second : fallback;
+		ReduceChannel(track->mPositionKeys, tolerance.mTranslation, stats, mixVector, vectorError);
+		ReduceChannel(track->mRotationKeys, tolerance.mRotation, stats, mixRotation, rotationError);
+		ReduceChannel(track->mScalingKeys, tolerance.mScale, stats, mixVector, vectorError);
+	}
+	return stats;
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include "Animation.h"
+
+// Allowed local error per channel of one track, derived from model space tolerances.
+struct KeyFrameTolerance {
+	float mTranslation = 0.0f; // Distance in the parent bone's space
+	float mRotation = 0.0f; // Radians
+	float mScale = 0.0f; // Scale factor
+};
+typedef std::unordered_map<std::string, KeyFrameTolerance> KeyFrameTolerances;
+
+struct ReductionStats {
+	size_t mKeysBefore = 0;
+	size_t mKeysAfter = 0;
+	size_t mConstantChannels = 0;
+};
+
+// Converts a model space distance and angle into per node tolerances. A node's rotation
+// and scale error moves everything below it, so they are tightened by the distance to
+// the furthest descendant in the bind pose. Translation errors are scaled by the parent.
+KeyFrameTolerances GetKeyFrameTolerances(const AnimationNode_& root, float distance, float angle);
+
+// Drops every key that interpolating its neighbours reproduces within tolerance and
+// collapses constant channels to one key. Tracks missing from tolerances use fallback.
+ReductionStats ReduceKeyFrames(Animation& animation, const KeyFrameTolerances& tolerances, const KeyFrameTolerance& fallback);
@@ -0,0 +1,116 @@
+#pragma once
+
+// Everything that doesn't need a window or GL context, see Main.h for the rest.
+
+#define MAX_VERTEX_WEIGHTS 4
+#define AI_LMW_MAX_WEIGHTS MAX_VERTEX_WEIGHTS
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#define GLM_ENABLE_EXPERIMENTAL
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtx/hash.hpp>
+#include "glm/ext.hpp"
+
+#include <cstring>
+#include <cstdlib>
+#include <cstdint>
+#include <vector>
+#include <map>
+#include <sstream>
+#include <iostream>
+#include <fstream>
+#include <stdexcept>
+#include <algorithm>
+#include <initializer_list>
+#include <list>
+#include <deque>
+#include <unordered_map>
+
+#include <rapidjson/document.h>
+#include <rapidjson/istreamwrapper.h>
+
+// Debug color derived from a name and an index, the same on every thread and every run.
+inline glm::vec3 DebugColor(const std::string& name, const size_t index) {
+	size_t hash = std::hash<std::string>()(name);
+	hash ^= std::hash<size_t>()(index) + 0x9e3779b9 + (hash << 6) + (hash >> 2);
+	return {
+		(float)(hash & 0xff) / 255.0f,
+		(float)((hash >> 8) & 0xff) / 255.0f,
+		(float)((hash >> 16) & 0xff) / 255.0f
+	};
+}
+
+inline std::string ReadFile(const std::string& path) {
+	std::ifstream stream(path, std::ios::in);
+	if (!stream.is_open()) {
+		std::string message = "Could not open file: " + path;
+		throw new std::runtime_error(message);
+	}
+	std::stringstream buffer;
+	buffer << stream.rdbuf();
+	const auto source = buffer.str();
+	stream.close();
+	return source;
+}
+
+// Non owning view of a contiguous array.
+template<typename T>
+struct Span {
+	T* mData = nullptr;
+	size_t mSize = 0;
+
+	Span() {}
+	Span(T* data, size_t size) : mData(data), mSize(size) {}
+
+	T* begin() const { return mData; }
+	T* end() const { return mData + mSize; }
+	T* data() const { return mData; }
+	size_t size() const { return mSize; }
+	bool empty() const { return mSize == 0; }
+	T& operator[](size_t index) const { return mData[index]; }
+};
+
+struct Camera {
+	glm::vec3 mPos = { 0,0,0 };
+	glm::vec3 mFront = { 0,0,1 };
+	glm::vec3 mUp = { 0,1,0 };
+	glm::vec3 mRight = { 1,0,0 };
+
+	float mFov = glm::radians(45.0f);
+	float mAspect = 1.0f;
+	float mNear = 0.1f;
+	float mFar = 1000.0f;
+
+	glm::mat4 mView;
+	glm::mat4 mProjection;
+
+	void Look(float yaw, float pitch) {
+		glm::vec3 dir = {
+			cos(glm::radians(yaw)) * cos(glm::radians(pitch)),
+			sin(glm::radians(pitch)),
+			sin(glm::radians(yaw)) * cos(glm::radians(pitch)),
+		};
+		mFront = glm::normalize(dir);
+	}
+
+	void SetAspect(int width, int height) {
+		mAspect = width / (float)height;
+	}
+
+	void UpdateView() {
+		mView = glm::lookAt(mPos, mPos + mFront, mUp);
+	}
+
+	void UpdateProjection() {
+		mProjection = glm::perspective(mFov, mAspect, mNear, mFar);
+	}
+
+	// Diameter of the sphere on screen relative to the viewport height.
+	float GetScreenSize(const glm::vec3& center, const float radius) const {
+		const float distance = glm::distance(mPos, center);
+		if (distance <= radius) return 1e6f;
+		return radius / (distance * std::tan(mFov * 0.5f));
+	}
+};
@@ -0,0 +1,174 @@
+#include "CpuSkinning.h"
+
+#include <cmath>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define SKINNING_KERNELS_X86
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define SKINNING_TARGET_AVX2
+#else
+#define SKINNING_TARGET_AVX2 __attribute__((target("avx2,fma")))
+#endif
+#endif
+
+// Kernels gather rows straight out of the palette, element e of bone b is at b * 12 + e
+#define SKINNING_BONE_FLOATS 12
+static_assert(sizeof(Affine) == SKINNING_BONE_FLOATS * sizeof(float), "Affine must be 3 packed rows");
+
+void SkinningSource::Init(const Span<const Vertex> vertices) {
+	mCount = vertices.size();
+	const size_t capacity = GetPaddedCount();
+	auto reset = [capacity](auto& values) {
+		values.assign(capacity, 0);
+	};
+	for (int c = 0; c < 3; ++c) {
+		reset(mPositions[c]);
+		reset(mNormals[c]);
+	}
+	for (size_t w = 0; w < MAX_VERTEX_WEIGHTS; ++w) {
+		reset(mWeights[w]);
+		reset(mIndices[w]);
+	}
+	reset(mRestWeights);
+
+	for (size_t i = 0; i < mCount; ++i) {
+		const auto& vertex = vertices[i];
+		for (int c = 0; c < 3; ++c) {
+			mPositions[c][i] = vertex.mPos[c];
+			mNormals[c][i] = vertex.mNormal[c];
+		}
+		// Same rule as the shader, the first weight decides whether a vertex is skinned
+		if (vertex.mBoneWeights[0] <= 0.0f) {
+			mRestWeights[i] = 1.0f;
+			continue;
+		}
+		for (size_t w = 0; w < MAX_VERTEX_WEIGHTS; ++w) {
+			mWeights[w][i] = vertex.mBoneWeights[w];
+			mIndices[w][i] = (int32_t)(vertex.mBoneIndices[w] * SKINNING_BONE_FLOATS);
+		}
+	}
+}
+
+void SkinLinearScalar(const SkinningSource& source, const Affine* palette, const size_t begin, const size_t end, SkinnedVertex* result) {
+	const float* bones = reinterpret_cast<const float*>(palette);
+	for (size_t i = begin; i < std::min(end, source.mCount); ++i) {
+		const float rest = source.mRestWeights[i];
+		float m[SKINNING_BONE_FLOATS] = { rest, 0, 0, 0, 0, rest, 0, 0, 0, 0, rest, 0 };
+		for (size_t w = 0; w < MAX_VERTEX_WEIGHTS; ++w) {
+			const float weight = source.mWeights[w][i];
+			const float* bone = bones + source.mIndices[w][i];
+			for (int e = 0; e < SKINNING_BONE_FLOATS; ++e) m[e] += bone[e] * weight;
+		}
+
+		const float p[3] = { source.mPositions[0][i], source.mPositions[1][i], source.mPositions[2][i] };
+		const float n[3] = { source.mNormals[0][i], source.mNormals[1][i], source.mNormals[2][i] };
+		float position[3], normal[3];
+		float length2 = 0.0f;
+		for (int r = 0; r < 3; ++r) {
+			const float* row = m + r * 4;
+			position[r] = row[0] * p[0] + row[1] * p[1] + row[2] * p[2] + row[3];
+			normal[r] = row[0] * n[0] + row[1] * n[1] + row[2] * n[2];
+			length2 += normal[r] * normal[r];
+		}
+		const float scale = 1.0f / std::sqrt(std::max(length2, 1e-30f));
+		result[i].mPos = { position[0], position[1], position[2] };
+		result[i].mNormal = { normal[0] * scale, normal[1] * scale, normal[2] * scale };
+	}
+}
+
+#ifdef SKINNING_KERNELS_X86
+
+// Eight vertices at a time. Every weight slot gathers the 12 elements of its bones, slots
+// that are empty for all eight vertices are skipped, most vertices have two bones or less.
+SKINNING_TARGET_AVX2 void SkinLinearAVX2(const SkinningSource& source, const Affine* palette, const size_t begin, const size_t end, SkinnedVertex* result) {
+	const float* bones = reinterpret_cast<const float*>(palette);
+	const __m256 zero = _mm256_setzero_ps();
+	const __m256 minLength2 = _mm256_set1_ps(1e-30f);
+	alignas(32) float lanes[6][SKINNING_KERNEL_WIDTH];
+	for (size_t i = begin; i < end; i += SKINNING_KERNEL_WIDTH) {
+		const __m256 rest = _mm256_load_ps(&source.mRestWeights[i]);
+		__m256 m[SKINNING_BONE_FLOATS];
+		// Start from rest * identity, the diagonal is every fifth element
+		for (int e = 0; e < SKINNING_BONE_FLOATS; ++e) m[e] = e % 5 == 0 ? rest : zero;
+		for (size_t w = 0; w < MAX_VERTEX_WEIGHTS; ++w) {
+			const __m256 weight = _mm256_load_ps(&source.mWeights[w][i]);
+			if (_mm256_movemask_ps(_mm256_cmp_ps(weight, zero, _CMP_NEQ_OQ)) == 0) continue;
+			const __m256i index = _mm256_load_si256((const __m256i*)&source.mIndices[w][i]);
+			for (int e = 0; e < SKINNING_BONE_FLOATS; ++e) {
+				m[e] = _mm256_fmadd_ps(_mm256_i32gather_ps(bones + e, index, 4), weight, m[e]);
+			}
+		}
+
+		__m256 p[3], n[3];
+		for (int c = 0; c < 3; ++c) {
+			p[c] = _mm256_load_ps(&source.mPositions[c][i]);
+			n[c] = _mm256_load_ps(&source.mNormals[c][i]);
+		}
+		__m256 normal[3];
+		__m256 length2 = zero;
+		for (int r = 0; r < 3; ++r) {
+			const __m256* row = m + r * 4;
+			const __m256 position = _mm256_fmadd_ps(row[0], p[0], _mm256_fmadd_ps(row[1], p[1], _mm256_fmadd_ps(row[2], p[2], row[3])));
+			normal[r] = _mm256_fmadd_ps(row[0], n[0], _mm256_fmadd_ps(row[1], n[1], _mm256_mul_ps(row[2], n[2])));
+			length2 = _mm256_fmadd_ps(normal[r], normal[r], length2);
+			_mm256_store_ps(lanes[r], position);
+		}
+		const __m256 length = _mm256_sqrt_ps(_mm256_max_ps(length2, minLength2));
+		for (int r = 0; r < 3; ++r) {
+			_mm256_store_ps(lanes[3 + r], _mm256_div_ps(normal[r], length));
+		}
+
+		// Transpose into the interleaved output
+		const size_t count = std::min<size_t>(SKINNING_KERNEL_WIDTH, source.mCount > i ? source.mCount - i : 0);
+		for (size_t l = 0; l < count; ++l) {
+			result[i + l].mPos = { lanes[0][l], lanes[1][l], lanes[2][l] };
+			result[i + l].mNormal = { lanes[3][l], lanes[4][l], lanes[5][l] };
+		}
+	}
+}
+
+bool CpuSupportsAVX2() {
+#if defined(_MSC_VER)
+	int info[4];
+	__cpuid(info, 1);
+	const bool fma = (info[2] & (1 << 12)) != 0;
+	const bool osxsave = (info[2] & (1 << 27)) != 0;
+	__cpuidex(info, 7, 0);
+	const bool avx2 = (info[1] & (1 << 5)) != 0;
+	// The OS also has to save the upper halves of the ymm registers
+	return avx2 && fma && osxsave && (_xgetbv(0) & 6) == 6;
+#else
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#endif
+}
+
+#endif
+
+const SkinningKernels gScalarSkinningKernels = { "scalar", SkinLinearScalar };
+#ifdef SKINNING_KERNELS_X86
+const SkinningKernels gAVX2SkinningKernels = { "avx2", SkinLinearAVX2 };
+#endif
+
+std::vector<const SkinningKernels*> GetAvailableSkinningKernels() {
+	std::vector<const SkinningKernels*> result = { &gScalarSkinningKernels };
+#ifdef SKINNING_KERNELS_X86
+	if (CpuSupportsAVX2()) result.push_back(&gAVX2SkinningKernels);
+#endif
+	return result;
+}
+
+const SkinningKernels& GetSkinningKernels() {
+	static const SkinningKernels* kernels = GetAvailableSkinningKernels().back();
+	return *kernels;
+}
+
+void SkinVertices(JobSystem& jobSystem, const SkinningKernels& kernels, const SkinningSource& source, const Affine* palette, SkinnedVertex* result) {
+	// Split in whole kernel widths so every range starts on an aligned lane
+	const size_t numBlocks = source.GetPaddedCount() / SKINNING_KERNEL_WIDTH;
+	jobSystem.ParallelFor(numBlocks, SKINNING_GRAIN_SIZE / SKINNING_KERNEL_WIDTH, [&](const size_t begin, const size_t end) {
+		kernels.mSkinLinear(source, palette, begin * SKINNING_KERNEL_WIDTH, end * SKINNING_KERNEL_WIDTH, result);
+	});
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include "Affine.h"
+#include "AnimationKernels.h"
+#include "JobSystem.h"
+#include "Vertex.h"
+
+// Linear blend skinning on the CPU, for skinned bounds, picking and exports, and for
+// machines without a GPU. Produces the same positions as default.vert.glsl with the
+// Affine palette of AnimationController::mFinalTransforms. Normals are transformed by
+// the blended matrix and renormalized, which is exact for rigid bones.
+
+#define SKINNING_KERNEL_WIDTH 8
+#define SKINNING_GRAIN_SIZE 4096 // Vertices per job
+
+// Largest distance from SkinLinear in Skinning.h relative to the model size, and largest
+// difference of the normals, checked by "AnimBench cpuskinning".
+#define CPU_SKINNING_TOLERANCE 1e-5f
+#define CPU_SKINNING_NORMAL_TOLERANCE 1e-4f
+
+struct SkinnedVertex {
+	glm::vec3 mPos = { 0, 0, 0 };
+	glm::vec3 mNormal = { 0, 0, 0 };
+};
+
+// Structure of arrays copy of the skinning inputs of a mesh, made once. Padded to the
+// kernel width with lanes that have no weights, so kernels never need a scalar tail.
+struct SkinningSource {
+	size_t mCount = 0;
+	AlignedVector<float> mPositions[3];
+	AlignedVector<float> mNormals[3];
+	AlignedVector<float> mWeights[MAX_VERTEX_WEIGHTS];
+	AlignedVector<int32_t> mIndices[MAX_VERTEX_WEIGHTS]; // Offsets in floats into the palette
+	AlignedVector<float> mRestWeights; // 1 for vertices without weights, which keep their bind pose
+
+	void Init(Span<const Vertex> vertices);
+
+	size_t GetPaddedCount() const {
+		return (mCount + SKINNING_KERNEL_WIDTH - 1) / SKINNING_KERNEL_WIDTH * SKINNING_KERNEL_WIDTH;
+	}
+};
+
+// Skinning kernel for one instruction set. Skins the vertices [begin, end) of source into
+// result[begin, end), begin must be a multiple of SKINNING_KERNEL_WIDTH. Lanes past
+// source.mCount are not written. The palette needs at least one bone.
+struct SkinningKernels {
+	const char* mName;
+	void (*mSkinLinear)(const SkinningSource& source, const Affine* palette, size_t begin, size_t end, SkinnedVertex* result);
+};
+
+// Fastest kernels supported by the running CPU.
+const SkinningKernels& GetSkinningKernels();
+
+// Every kernel set supported by the running CPU, scalar first.
+std::vector<const SkinningKernels*> GetAvailableSkinningKernels();
+
+// Skins all vertices of source into result, in ranges of SKINNING_GRAIN_SIZE spread over the
+// threads of the job system. The result does not depend on the thread count.
+void SkinVertices(JobSystem& jobSystem, const SkinningKernels& kernels, const SkinningSource& source, const Affine* palette, SkinnedVertex* result);
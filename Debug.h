@@ -2,6 +2,7 @@
 
 #include "Main.h"
 #include "Shader.h"
+#include "StreamBuffer.h"
 
 struct DebugLine {
 	glm::vec3 mStart;
@@ -9,6 +10,7 @@ struct DebugLine {
 	glm::vec3 mColor;
 };
 
+// Also the per instance vertex layout of particles.vert.glsl
 struct DebugPoint {
 	glm::vec3 mPos;
 	glm::vec3 mColor = { 1,1,1 };
@@ -20,17 +22,43 @@ struct DebugPoint {
 	}
 };
 
+// Line end point as drawn by debug.vert.glsl
+struct DebugVertex {
+	glm::vec3 mPos;
+	glm::vec3 mColor;
+};
+
+// Collects lines and points during the frame and draws them with one GL_LINES draw and one
+// instanced draw of a camera facing quad per point, both read from a StreamBuffer.
 struct DebugOverlay {
 	std::vector<DebugLine> mLines;
 	std::vector<DebugPoint> mPoints;
 	ShaderProgram_ mLineProgram;
 	ShaderProgram_ mPointProgram;
+	GLint mLineProj, mLineView;
+	GLint mPointProj, mPointView;
+	StreamBuffer mBuffer = StreamBuffer(GL_ARRAY_BUFFER);
+	GLuint mLineVertexArray = 0;
+	GLuint mPointVertexArray = 0;
 	bool mDepthTest = true;
 	bool mEnabled = true;
+	size_t mPrimitives = 0; // Lines and points drawn by the last Render
 
 	DebugOverlay() {
 		mLineProgram = ShaderProgram::Load("debug");
 		mPointProgram = ShaderProgram::Load("particles");
+		mLineProj = glGetUniformLocation(mLineProgram->mID, "uProj");
+		mLineView = glGetUniformLocation(mLineProgram->mID, "uView");
+		mPointProj = glGetUniformLocation(mPointProgram->mID, "uProj");
+		mPointView = glGetUniformLocation(mPointProgram->mID, "uView");
+		glGenVertexArrays(1, &mLineVertexArray);
+		glGenVertexArrays(1, &mPointVertexArray);
+	}
+	DebugOverlay(const DebugOverlay&) = delete;
+	DebugOverlay& operator=(const DebugOverlay&) = delete;
+	~DebugOverlay() {
+		glDeleteVertexArrays(1, &mLineVertexArray);
+		glDeleteVertexArrays(1, &mPointVertexArray);
 	}
 
 	void Clear() {
@@ -47,6 +75,19 @@ struct DebugOverlay {
 		}
 	}
 
+	void AddBox(const glm::mat4& transform, const AABB& aabb, const glm::vec3& color) {
+		glm::vec3 corners[8];
+		for (int i = 0; i < 8; ++i) {
+			const glm::vec3 sign = { i & 1 ? 1 : -1, i & 2 ? 1 : -1, i & 4 ? 1 : -1 };
+			corners[i] = glm::vec3(transform * glm::vec4(aabb.mCenter + aabb.mHalfSize * sign, 1.0f));
+		}
+		for (int i = 0; i < 8; ++i) {
+			for (int axis = 1; axis < 8; axis <<= 1) {
+				if (!(i & axis)) AddLine({ corners[i], corners[i | axis], color });
+			}
+		}
+	}
+
 	void AddPoint(const DebugPoint& point) {
 		mPoints.push_back(point);
 	}
@@ -56,72 +97,56 @@ struct DebugOverlay {
 	}
 
 	void Render(const Camera& cam) {
+		mPrimitives = 0;
+		if (mLines.empty() && mPoints.empty()) return;
 		if(mDepthTest) glEnable(GL_DEPTH_TEST);
 		else glDisable(GL_DEPTH_TEST);
 
-		auto drawDebugLines = [](auto& debugLines) {
-			size_t count = 0;
-			for(auto& debugLine : debugLines) {
-				if(count++ > 10000) break;
-				// FIXME!
-				auto debugMesh = std::make_shared<Mesh>();
-				debugMesh->mIndices.push_back(0);
-				debugMesh->mIndices.push_back(1);
-				debugMesh->mVertices.push_back({
-					debugLine.mStart,
-					{},
-					debugLine.mColor
-				});
-				debugMesh->mVertices.push_back({
-					debugLine.mEnd,
-					{},
-					debugLine.mColor
-				});
-				debugMesh->Bind();
-				glDrawElements(GL_LINES, debugMesh->mIndices.size(), GL_UNSIGNED_INT, 0);
-			}
-		};
-
-		auto drawDebugPoints = [](auto& debugPoints) {
-			auto debugMesh = std::make_shared<Mesh>();
-			for(auto& debugPoint : debugPoints) {
-				float ps = 0.25f;
-				float quad[] = {
-					0.0f, 0.0f, 1.0f, 0.0f, 1.0f, 1.0f,
-					0.0f, 0.0f, 1.0f, 1.0f, 0.0f, 1.0f,
-				};
-				for(int v = 0; v < 12; v += 2) {
-					Vertex vertex;
-					vertex.mPos = debugPoint.mPos;
-					vertex.mNormal.x = (quad[v] - 0.5f) * ps;
-					vertex.mNormal.y = (quad[v + 1] - 0.5f) * ps;
-					vertex.mNormal.z = debugPoint.mScale;
-					debugMesh->mIndices.push_back(debugMesh->mIndices.size());
-					debugMesh->mVertices.push_back(vertex);
-				}
-			}
-			debugMesh->Bind();
-			glDrawElements(GL_TRIANGLES, debugMesh->mIndices.size(), GL_UNSIGNED_INT, 0);
-		};
-
-		auto debugTransform = glm::identity<glm::mat4>();
+		// Line vertices first, then the points
+		const size_t lineBytes = mLines.size() * 2 * sizeof(DebugVertex);
+		const size_t pointBytes = mPoints.size() * sizeof(DebugPoint);
+		auto vertices = (DebugVertex*)mBuffer.Begin(lineBytes + pointBytes);
+		for (const auto& line : mLines) {
+			*vertices++ = { line.mStart, line.mColor };
+			*vertices++ = { line.mEnd, line.mColor };
+		}
+		if (pointBytes > 0) std::memcpy((uint8_t*)vertices, mPoints.data(), pointBytes);
+		const size_t lineOffset = mBuffer.GetOffset();
+		const size_t pointOffset = lineOffset + lineBytes;
+		glBindBuffer(GL_ARRAY_BUFFER, mBuffer.mBuffer);
 
 		if(mLines.size()) {
 			glUseProgram(mLineProgram->mID);
-			glUniformMatrix4fv(glGetUniformLocation(mLineProgram->mID, "uProj"), 1, GL_FALSE, (GLfloat*)&cam.mProjection[0]);
-			glUniformMatrix4fv(glGetUniformLocation(mLineProgram->mID, "uView"), 1, GL_FALSE, (GLfloat*)&cam.mView[0]);
-			glUniformMatrix4fv(glGetUniformLocation(mLineProgram->mID, "uModel"), 1, GL_FALSE, (GLfloat*)&debugTransform[0]);
-
-			drawDebugLines(mLines);
+			glUniformMatrix4fv(mLineProj, 1, GL_FALSE, (GLfloat*)&cam.mProjection[0]);
+			glUniformMatrix4fv(mLineView, 1, GL_FALSE, (GLfloat*)&cam.mView[0]);
+			glBindVertexArray(mLineVertexArray);
+			MapAttribute(0, 3, sizeof(DebugVertex), lineOffset + offsetof(DebugVertex, mPos), 0);
+			MapAttribute(2, 3, sizeof(DebugVertex), lineOffset + offsetof(DebugVertex, mColor), 0);
+			glDrawArrays(GL_LINES, 0, (GLsizei)mLines.size() * 2);
 		}
 
 		if(mPoints.size()) {
 			glUseProgram(mPointProgram->mID);
-			glUniformMatrix4fv(glGetUniformLocation(mPointProgram->mID, "uProj"), 1, GL_FALSE, (GLfloat*)&cam.mProjection[0]);
-			glUniformMatrix4fv(glGetUniformLocation(mPointProgram->mID, "uView"), 1, GL_FALSE, (GLfloat*)&cam.mView[0]);
-			glUniformMatrix4fv(glGetUniformLocation(mPointProgram->mID, "uModel"), 1, GL_FALSE, (GLfloat*)&debugTransform[0]);
-
-			drawDebugPoints(mPoints);
+			glUniformMatrix4fv(mPointProj, 1, GL_FALSE, (GLfloat*)&cam.mProjection[0]);
+			glUniformMatrix4fv(mPointView, 1, GL_FALSE, (GLfloat*)&cam.mView[0]);
+			glBindVertexArray(mPointVertexArray);
+			MapAttribute(0, 3, sizeof(DebugPoint), pointOffset + offsetof(DebugPoint, mPos), 1);
+			MapAttribute(2, 3, sizeof(DebugPoint), pointOffset + offsetof(DebugPoint, mColor), 1);
+			MapAttribute(1, 1, sizeof(DebugPoint), pointOffset + offsetof(DebugPoint, mScale), 1);
+			glDrawArraysInstanced(GL_TRIANGLES, 0, 6, (GLsizei)mPoints.size());
 		}
+
+		glBindVertexArray(0);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		mBuffer.End();
+		mPrimitives = mLines.size() + mPoints.size();
+	}
+
+protected:
+	// The region moves every frame, so attributes are pointed at it on every Render
+	static void MapAttribute(const GLuint index, const GLint size, const size_t stride, const size_t offset, const GLuint divisor) {
+		glEnableVertexAttribArray(index);
+		glVertexAttribPointer(index, size, GL_FLOAT, GL_FALSE, (GLsizei)stride, (GLvoid*)offset);
+		glVertexAttribDivisor(index, divisor);
 	}
 };
@@ -0,0 +1,57 @@
+#pragma once
+
+#include "Affine.h"
+
+// Rigid transform as a unit dual quaternion, 32 bytes. Blending dual quaternions keeps
+// the volume of twisting joints where blending matrices collapses it (candy wrapper).
+// Scale and shear can't be represented and are dropped by FromAffine.
+struct DualQuat {
+	glm::quat mReal = { 1, 0, 0, 0 }; // Rotation
+	glm::quat mDual = { 0, 0, 0, 0 }; // 0.5 * translation * mReal
+
+	static DualQuat FromAffine(const Affine& a) {
+		// Rotation from the normalized axes, see Shepperd's method
+		float m[3][3];
+		for (int c = 0; c < 3; ++c) {
+			const float length = std::sqrt(a.mRows[0][c] * a.mRows[0][c] + a.mRows[1][c] * a.mRows[1][c] + a.mRows[2][c] * a.mRows[2][c]);
+			const float scale = length > 0.0f ? 1.0f / length : 0.0f;
+			for (int r = 0; r < 3; ++r) m[r][c] = a.mRows[r][c] * scale;
+		}
+		glm::quat q;
+		const float trace = m[0][0] + m[1][1] + m[2][2];
+		if (trace > 0.0f) {
+			const float s = std::sqrt(trace + 1.0f) * 2.0f;
+			q = glm::quat(0.25f * s, (m[2][1] - m[1][2]) / s, (m[0][2] - m[2][0]) / s, (m[1][0] - m[0][1]) / s);
+		} else if (m[0][0] > m[1][1] && m[0][0] > m[2][2]) {
+			const float s = std::sqrt(1.0f + m[0][0] - m[1][1] - m[2][2]) * 2.0f;
+			q = glm::quat((m[2][1] - m[1][2]) / s, 0.25f * s, (m[0][1] + m[1][0]) / s, (m[0][2] + m[2][0]) / s);
+		} else if (m[1][1] > m[2][2]) {
+			const float s = std::sqrt(1.0f + m[1][1] - m[0][0] - m[2][2]) * 2.0f;
+			q = glm::quat((m[0][2] - m[2][0]) / s, (m[0][1] + m[1][0]) / s, 0.25f * s, (m[1][2] + m[2][1]) / s);
+		} else {
+			const float s = std::sqrt(1.0f + m[2][2] - m[0][0] - m[1][1]) * 2.0f;
+			q = glm::quat((m[1][0] - m[0][1]) / s, (m[0][2] + m[2][0]) / s, (m[1][2] + m[2][1]) / s, 0.25f * s);
+		}
+		const float length = std::sqrt(q.w * q.w + q.x * q.x + q.y * q.y + q.z * q.z);
+		q = glm::quat(q.w / length, q.x / length, q.y / length, q.z / length);
+
+		const glm::vec3 t = a.GetTranslation();
+		DualQuat dq;
+		dq.mReal = q;
+		dq.mDual = glm::quat(
+			-0.5f * (t.x * q.x + t.y * q.y + t.z * q.z),
+			0.5f * (q.w * t.x + t.y * q.z - t.z * q.y),
+			0.5f * (q.w * t.y + t.z * q.x - t.x * q.z),
+			0.5f * (q.w * t.z + t.x * q.y - t.y * q.x));
+		return dq;
+	}
+
+	// Same as default.vert.glsl, the dual quaternion must be normalized.
+	glm::vec3 TransformPoint(const glm::vec3& p) const {
+		const glm::vec3 r = { mReal.x, mReal.y, mReal.z };
+		const glm::vec3 d = { mDual.x, mDual.y, mDual.z };
+		const glm::vec3 rotated = glm::cross(r, glm::cross(r, p) + p * mReal.w);
+		const glm::vec3 translation = d * mReal.w - r * mDual.w + glm::cross(r, d);
+		return p + (rotated + translation) * 2.0f;
+	}
+};
@@ -0,0 +1,160 @@
+#pragma once
+
+#include "Mesh.h"
+
+// Large vertex and index buffers that the meshes of the scene are suballocated from, so
+// the whole scene draws from a few buffers instead of a VBO, EBO and VAO per mesh. A draw
+// call uses a single vertex format and index type, so there is a pool for each combination.
+// Every pool's VAO also feeds the draw index (location 6) as a per instance attribute, the
+// baseInstance of a draw picks its DrawData, see Renderer.h.
+// Space is never freed, a full pool is copied into buffers twice its size.
+
+#define GEOMETRY_POOLS 4
+
+struct GeometryPool {
+	bool mPacked = false;
+	bool mShortIndices = false;
+	GLuint mVertexBuffer = 0;
+	GLuint mIndexBuffer = 0;
+	GLuint mVertexArray = 0;
+	size_t mVertexCapacity = 0; // In vertices
+	size_t mVertexCount = 0;
+	size_t mIndexCapacity = 0; // In indices
+	size_t mIndexCount = 0;
+
+	size_t GetVertexSize() const {
+		return mPacked ? sizeof(PackedVertex) : sizeof(Vertex);
+	}
+	size_t GetIndexSize() const {
+		return mShortIndices ? sizeof(uint16_t) : sizeof(uint32_t);
+	}
+	GLenum GetIndexType() const {
+		return mShortIndices ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+	}
+};
+
+struct GeometryBuffer {
+	GeometryPool mPools[GEOMETRY_POOLS];
+	GLuint mDrawIndexBuffer = 0; // 0, 1, 2, ... read per instance
+	size_t mDrawIndexCapacity = 0;
+
+	GeometryBuffer() {
+		for (int i = 0; i < GEOMETRY_POOLS; ++i) {
+			mPools[i].mPacked = (i & 2) != 0;
+			mPools[i].mShortIndices = (i & 1) != 0;
+		}
+	}
+	GeometryBuffer(const GeometryBuffer&) = delete;
+	GeometryBuffer& operator=(const GeometryBuffer&) = delete;
+	~GeometryBuffer() {
+		for (auto& pool : mPools) {
+			if (pool.mVertexBuffer) glDeleteBuffers(1, &pool.mVertexBuffer);
+			if (pool.mIndexBuffer) glDeleteBuffers(1, &pool.mIndexBuffer);
+			if (pool.mVertexArray) glDeleteVertexArrays(1, &pool.mVertexArray);
+		}
+		if (mDrawIndexBuffer) glDeleteBuffers(1, &mDrawIndexBuffer);
+	}
+
+	static int GetPoolIndex(const Mesh& mesh) {
+		return (mesh.IsPacked() ? 2 : 0) | (mesh.HasShortIndices() ? 1 : 0);
+	}
+
+	// Reserves the mesh's range, its contents are written by Upload or MeshUploader.
+	void Allocate(Mesh& mesh) {
+		if (mesh.mGeometryPool >= 0) return;
+		const int poolIndex = GetPoolIndex(mesh);
+		auto& pool = mPools[poolIndex];
+		const size_t numVertices = mesh.GetVertices().size();
+		const size_t numIndices = mesh.GetIndices().size();
+		Reserve(pool, pool.mVertexCount + numVertices, pool.mIndexCount + numIndices);
+		mesh.mGeometryPool = poolIndex;
+		mesh.mBaseVertex = (uint32_t)pool.mVertexCount;
+		mesh.mBaseIndex = (uint32_t)pool.mIndexCount;
+		pool.mVertexCount += numVertices;
+		pool.mIndexCount += numIndices;
+	}
+
+	// Allocates and fills the mesh's range right away.
+	void Upload(Mesh& mesh) {
+		Allocate(mesh);
+		const auto& pool = mPools[mesh.mGeometryPool];
+		glBindBuffer(GL_COPY_WRITE_BUFFER, pool.mVertexBuffer);
+		glBufferSubData(GL_COPY_WRITE_BUFFER, mesh.mBaseVertex * pool.GetVertexSize(), mesh.GetVertexBufferSize(), mesh.GetVertexBufferData());
+		std::vector<uint8_t> indices(mesh.GetIndexBufferSize());
+		mesh.CopyIndexBufferData(indices.data(), 0, mesh.GetIndices().size());
+		glBindBuffer(GL_COPY_WRITE_BUFFER, pool.mIndexBuffer);
+		glBufferSubData(GL_COPY_WRITE_BUFFER, mesh.mBaseIndex * pool.GetIndexSize(), indices.size(), indices.data());
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	}
+
+	// Makes sure draws up to count can read their draw index.
+	void ReserveDraws(const size_t count) {
+		if (count <= mDrawIndexCapacity) return;
+		mDrawIndexCapacity = std::max<size_t>(count, mDrawIndexCapacity * 2);
+		std::vector<uint32_t> drawIndices(mDrawIndexCapacity);
+		for (size_t i = 0; i < drawIndices.size(); ++i) drawIndices[i] = (uint32_t)i;
+		if (!mDrawIndexBuffer) glGenBuffers(1, &mDrawIndexBuffer);
+		glBindBuffer(GL_ARRAY_BUFFER, mDrawIndexBuffer);
+		glBufferData(GL_ARRAY_BUFFER, drawIndices.size() * sizeof(uint32_t), drawIndices.data(), GL_STATIC_DRAW);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		for (auto& pool : mPools) {
+			if (pool.mVertexArray) UpdateVertexArray(pool);
+		}
+	}
+
+	void Bind(const GeometryPool& pool) const {
+		glBindVertexArray(pool.mVertexArray);
+	}
+
+protected:
+	void Reserve(GeometryPool& pool, const size_t numVertices, const size_t numIndices) {
+		const bool growVertices = numVertices > pool.mVertexCapacity;
+		const bool growIndices = numIndices > pool.mIndexCapacity;
+		if (growVertices) {
+			pool.mVertexCapacity = std::max<size_t>({ numVertices, pool.mVertexCapacity * 2, 1 << 16 });
+			Grow(pool.mVertexBuffer, pool.mVertexCount * pool.GetVertexSize(), pool.mVertexCapacity * pool.GetVertexSize());
+		}
+		if (growIndices) {
+			pool.mIndexCapacity = std::max<size_t>({ numIndices, pool.mIndexCapacity * 2, 1 << 18 });
+			Grow(pool.mIndexBuffer, pool.mIndexCount * pool.GetIndexSize(), pool.mIndexCapacity * pool.GetIndexSize());
+		}
+		if (growVertices || growIndices || !pool.mVertexArray) UpdateVertexArray(pool);
+	}
+
+	// Replaces the buffer with a larger one holding the same first usedBytes. Reads through
+	// GL_ARRAY_BUFFER since MeshUploader keeps its staging buffer on GL_COPY_READ_BUFFER.
+	static void Grow(GLuint& buffer, const size_t usedBytes, const size_t bytes) {
+		GLuint grown = 0;
+		glGenBuffers(1, &grown);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, grown);
+		glBufferData(GL_COPY_WRITE_BUFFER, bytes, nullptr, GL_STATIC_DRAW);
+		if (buffer) {
+			glBindBuffer(GL_ARRAY_BUFFER, buffer);
+			if (usedBytes > 0) glCopyBufferSubData(GL_ARRAY_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, usedBytes);
+			glBindBuffer(GL_ARRAY_BUFFER, 0);
+			glDeleteBuffers(1, &buffer);
+		}
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+		buffer = grown;
+	}
+
+	void UpdateVertexArray(GeometryPool& pool) {
+		if (!pool.mVertexArray) glGenVertexArrays(1, &pool.mVertexArray);
+		glBindVertexArray(pool.mVertexArray);
+		glBindBuffer(GL_ARRAY_BUFFER, pool.mVertexBuffer);
+		if (pool.mPacked) {
+			PackedVertex::MapVertexArray();
+		} else {
+			Vertex::MapVertexArray();
+		}
+		if (mDrawIndexBuffer) {
+			glBindBuffer(GL_ARRAY_BUFFER, mDrawIndexBuffer);
+			glEnableVertexAttribArray(6);
+			glVertexAttribIPointer(6, 1, GL_UNSIGNED_INT, sizeof(uint32_t), (GLvoid*)0);
+			glVertexAttribDivisor(6, 1);
+		}
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, pool.mIndexBuffer);
+		glBindVertexArray(0);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+};
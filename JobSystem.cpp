@@ -0,0 +1,115 @@
+#include "JobSystem.h"
+
+#include <algorithm>
+
+bool JobQueue::Push(const Job& job) {
+	std::lock_guard<std::mutex> lock(mMutex);
+	if (mCount == JOB_QUEUE_CAPACITY) return false;
+	mJobs[(mFront + mCount) % JOB_QUEUE_CAPACITY] = job;
+	mCount++;
+	return true;
+}
+
+bool JobQueue::Pop(Job& job) {
+	std::lock_guard<std::mutex> lock(mMutex);
+	if (mCount == 0) return false;
+	mCount--;
+	job = mJobs[(mFront + mCount) % JOB_QUEUE_CAPACITY];
+	return true;
+}
+
+bool JobQueue::Steal(Job& job) {
+	std::lock_guard<std::mutex> lock(mMutex);
+	if (mCount == 0) return false;
+	job = mJobs[mFront];
+	mFront = (mFront + 1) % JOB_QUEUE_CAPACITY;
+	mCount--;
+	return true;
+}
+
+JobSystem::JobSystem(size_t numThreads) {
+	if (numThreads == 0) {
+		numThreads = std::max(1u, std::thread::hardware_concurrency());
+	}
+	for (size_t i = 0; i < numThreads; ++i) {
+		mQueues.push_back(std::make_unique<JobQueue>());
+	}
+	for (size_t i = 1; i < numThreads; ++i) {
+		mWorkers.emplace_back(&JobSystem::WorkerLoop, this, i);
+	}
+}
+
+JobSystem::~JobSystem() {
+	{
+		std::lock_guard<std::mutex> lock(mWakeMutex);
+		mStop = true;
+	}
+	mWakeCondition.notify_all();
+	for (auto& worker : mWorkers) {
+		worker.join();
+	}
+}
+
+void JobSystem::Run(const size_t count, size_t grainSize, const JobFunction function, void* data) {
+	if (count == 0) return;
+	const size_t numThreads = mQueues.size();
+	// Enough jobs per thread to balance uneven ranges, few enough to fit the queues
+	grainSize = std::max({ grainSize, (count + numThreads * JOBS_PER_THREAD - 1) / (numThreads * JOBS_PER_THREAD), (size_t)1 });
+	if (numThreads == 1 || count <= grainSize) {
+		function(data, 0, count);
+		return;
+	}
+
+	std::atomic<size_t> remaining = { (count + grainSize - 1) / grainSize };
+	size_t queueIndex = 0;
+	for (size_t begin = 0; begin < count; begin += grainSize) {
+		Job job = { function, data, begin, std::min(begin + grainSize, count), &remaining };
+		mQueuedJobs++;
+		if (!mQueues[queueIndex]->Push(job)) {
+			mQueuedJobs--;
+			Execute(job);
+		}
+		queueIndex = (queueIndex + 1) % numThreads;
+	}
+	{
+		std::lock_guard<std::mutex> lock(mWakeMutex);
+	}
+	mWakeCondition.notify_all();
+
+	while (remaining.load(std::memory_order_acquire) > 0) {
+		Job job;
+		if (TakeJob(0, job)) {
+			Execute(job);
+		} else {
+			std::this_thread::yield();
+		}
+	}
+}
+
+// Own queue first, then the other threads' queues in order.
+bool JobSystem::TakeJob(const size_t threadIndex, Job& job) {
+	bool found = mQueues[threadIndex]->Pop(job);
+	for (size_t i = 1; i < mQueues.size() && !found; ++i) {
+		found = mQueues[(threadIndex + i) % mQueues.size()]->Steal(job);
+	}
+	if (found) mQueuedJobs--;
+	return found;
+}
+
+void JobSystem::Execute(const Job& job) {
+	job.mFunction(job.mData, job.mBegin, job.mEnd);
+	job.mRemaining->fetch_sub(1, std::memory_order_release);
+}
+
+void JobSystem::WorkerLoop(const size_t threadIndex) {
+	while (true) {
+		Job job;
+		if (TakeJob(threadIndex, job)) {
+			Execute(job);
+			continue;
+		}
+		std::unique_lock<std::mutex> lock(mWakeMutex);
+		mWakeCondition.wait(lock, [this]() { return mStop || mQueuedJobs > 0; });
+		if (mStop) return;
+	}
+}
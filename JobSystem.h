@@ -0,0 +1,73 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#define JOB_QUEUE_CAPACITY 1024
+#define JOBS_PER_THREAD 16
+
+typedef void (*JobFunction)(void* data, size_t begin, size_t end);
+
+// One range of a ParallelFor.
+struct Job {
+	JobFunction mFunction = nullptr;
+	void* mData = nullptr;
+	size_t mBegin = 0;
+	size_t mEnd = 0;
+	std::atomic<size_t>* mRemaining = nullptr;
+};
+
+// Fixed size ring of jobs, the owning thread pops from the back and other threads steal from the front.
+struct JobQueue {
+	std::mutex mMutex;
+	Job mJobs[JOB_QUEUE_CAPACITY];
+	size_t mFront = 0;
+	size_t mCount = 0;
+
+	bool Push(const Job& job);
+	bool Pop(Job& job);
+	bool Steal(Job& job);
+};
+
+// Work stealing scheduler. Thread 0 is whoever calls ParallelFor and works along, the other
+// threads sleep while there is nothing to do. With one thread everything runs inline.
+// Jobs are plain function pointers and fixed size queues, so running them never allocates.
+// Results only depend on the thread count if the callback writes to shared state.
+// ParallelFor must not be called from several threads at once or from inside a job.
+struct JobSystem {
+	std::vector<std::unique_ptr<JobQueue>> mQueues; // One per thread
+	std::vector<std::thread> mWorkers;
+	std::atomic<size_t> mQueuedJobs = { 0 };
+	std::mutex mWakeMutex;
+	std::condition_variable mWakeCondition;
+	bool mStop = false;
+
+	// numThreads includes the calling thread, 0 uses every hardware thread.
+	JobSystem(size_t numThreads = 0);
+	~JobSystem();
+
+	size_t GetThreadCount() const {
+		return mQueues.size();
+	}
+
+	// Calls function(begin, end) for consecutive ranges covering [0, count) and returns when all
+	// of them are done. Ranges are at least grainSize long.
+	template<typename TFunction>
+	void ParallelFor(const size_t count, const size_t grainSize, TFunction function) {
+		Run(count, grainSize, [](void* data, size_t begin, size_t end) {
+			(*static_cast<TFunction*>(data))(begin, end);
+		}, &function);
+	}
+
+protected:
+	void Run(size_t count, size_t grainSize, JobFunction function, void* data);
+	bool TakeJob(size_t threadIndex, Job& job);
+	void Execute(const Job& job);
+	void WorkerLoop(size_t threadIndex);
+};
+typedef std::shared_ptr<JobSystem> JobSystem_;
@@ -3,6 +3,8 @@
 #include "Shader.h"
 #include "UI.h"
 #include "Debug.h"
+#include "MeshUploader.h"
+#include "Renderer.h"
 
 DebugOverlay* gDebugOverlay = nullptr;
 double gMouseX = 0;
@@ -17,32 +19,20 @@ Scene_ CreateScene(const int argc, const char** argv) {
 	return scene;
 }
 
-void RenderNode(GLint uniformModel, ModelNode_ node, const glm::mat4& parentTransform) {
-	glm::mat4 transform = parentTransform * node->mTransform;
-	glUniformMatrix4fv(uniformModel, 1, GL_FALSE, (GLfloat*)&transform[0]);
-	for (auto& mesh : node->mMeshes) {
-		if (mesh->mHidden) continue;
-		mesh->Bind();
-		glDrawElements(GL_TRIANGLES, mesh->mIndices.size(), GL_UNSIGNED_INT, 0);
-	}
-	for (auto& childNode : node->mChildren) {
-		RenderNode(uniformModel, childNode, transform);
-	}
-};
-
-void RenderSkeleton(Model_ model, AnimationController_ ac, float now, const glm::mat4& parentTransform, bool points, bool lines) {
-	int counter = 0;
-	ac->BlendNodeHierarchy([parentTransform, points, lines, &counter](auto index, const auto& t, const auto& pt, const auto& ot) {
-		if(++counter < 2) return;
-		auto p = parentTransform * t * glm::vec4(0, 0, 0, 1.0f);
+// Draws the pose of the last AnimationController::Update, the first joint is left out.
+void RenderSkeleton(const AnimationController& ac, const glm::mat4& parentTransform, bool points, bool lines) {
+	const auto transforms = ac.GetJointTransforms();
+	for (size_t i = 1; i < transforms.size(); ++i) {
+		const auto p = glm::vec3(parentTransform * glm::vec4(transforms[i].GetTranslation(), 1.0f));
 		if(points) {
-			gDebugOverlay->AddPoint(DebugPoint(p.x, p.y, p.z, 0.02f));
+			gDebugOverlay->AddPoint(DebugPoint(p, 0.02f));
 		}
 		if(lines) {
-			auto p2 = parentTransform * pt * glm::vec4(0, 0, 0, 1.0f);
-			gDebugOverlay->AddLine({ {p.x, p.y, p.z}, { p2.x, p2.y, p2.z }, {1,1,0} });
+			const int32_t parent = ac.GetJointParent(i);
+			const auto p2 = glm::vec3(parentTransform * (parent < 0 ? glm::vec4(0, 0, 0, 1) : glm::vec4(transforms[parent].GetTranslation(), 1.0f)));
+			gDebugOverlay->AddLine({ p, p2, {1,1,0} });
 		}
-	}, now);
+	}
 }
 
 int main(const int argc, const char **argv) {
@@ -51,8 +41,9 @@ int main(const int argc, const char **argv) {
 		return -1;
 	}
 
-	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+	// Shader storage buffers and multi-draw indirect, see Renderer.h
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 5);
 	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
 	glfwWindowHint(GLFW_RESIZABLE, GL_FALSE);
 
@@ -88,8 +79,6 @@ int main(const int argc, const char **argv) {
 
 	const GLuint uniformProj = glGetUniformLocation(program->mID, "uProj");
 	const GLuint uniformView = glGetUniformLocation(program->mID, "uView");
-	const GLuint uniformModel = glGetUniformLocation(program->mID, "uModel");
-	const GLuint uniformBones = glGetUniformLocation(program->mID, "uBones");
 	const GLuint uLightPos = glGetUniformLocation(program->mID, "uLightPos");
 	const GLuint uViewPos = glGetUniformLocation(program->mID, "uViewPos");
 	const GLuint uLightColor = glGetUniformLocation(program->mID, "uLightColor");
@@ -132,10 +121,36 @@ int main(const int argc, const char **argv) {
 	std::unordered_map<size_t, bool> animWeightBonesTest;
 	std::unordered_map<size_t, bool> animTracksBonesTest;
 
+	// Both own GL objects, so they are released below before the context goes away
+	auto renderer = std::make_unique<Renderer>();
+	auto uploader = std::make_unique<MeshUploader>(scene->mUploadBudget, &renderer->mGeometry);
+	double submitTime = 0.0; // Milliseconds of CPU time to queue and submit the scene
+	bool streaming = scene->IsStreaming();
+	double lastFrameTime = glfwGetTime();
+	double maxFrameTime = 0.0; // Milliseconds, while streaming
+
 	while (!glfwWindowShouldClose(window)) {
 		const auto deltaTime = timer.Update();
 		const auto inputDelta = inputTimer.Update();
 
+		const double frameTime = (glfwGetTime() - lastFrameTime) * 1000.0;
+		lastFrameTime = glfwGetTime();
+		if (streaming) {
+			maxFrameTime = std::max(maxFrameTime, frameTime);
+			for (const auto& model : scene->UpdateStreaming()) {
+				uploader->Add(model);
+			}
+			uploader->Update();
+			if (!scene->mSelected && !scene->mEntities.empty()) {
+				scene->SelectNext();
+			}
+			if (!scene->IsStreaming() && uploader->IsIdle()) {
+				streaming = false;
+				std::cout << "Streamed " << scene->mEntities.size() << " entities, uploaded " << uploader->mTotalBytes
+					<< " bytes at " << uploader->mBudget << " bytes/frame, max frame time " << maxFrameTime << " ms" << std::endl;
+			}
+		}
+
 		if (fps.Tick(glfwGetTime())) {
 			glfwSetWindowTitle(window, (windowTitle + " - FPS: " + std::to_string(fps.mValue)).c_str());
 		}
@@ -187,12 +202,46 @@ int main(const int argc, const char **argv) {
 		if (selectedModel) {
 			ImGui::Checkbox("Debug Skeleton", &debugSkeleton);
 			ImGui::Checkbox("Debug Nodes", &debugNodes);
+			ImGui::SameLine();
+			ImGui::Text("%d debug primitives", (int)gDebugOverlay->mPrimitives);
+			ImGui::Checkbox("LODs", &renderer->mLods);
+			ImGui::SameLine();
+			ImGui::Checkbox("Multi-draw indirect", &renderer->mMultiDraw);
+			ImGui::SameLine();
+			ImGui::Checkbox("Instancing", &renderer->mInstancing);
+			if (auto& ac = scene->mSelected->mAnimationController) {
+				bool dualQuaternions = ac->mSkinning == SkinningMode::DualQuaternion;
+				if (ImGui::Checkbox("Dual quaternion skinning", &dualQuaternions)) {
+					scene->mSelected->mSkinning = dualQuaternions ? SkinningMode::DualQuaternion : SkinningMode::Linear;
+					ac->SetSkinning(scene->mSelected->mSkinning);
+				}
+			}
+			ImGui::Text("Triangles drawn: %d, %d draw calls, submitted in %.3f ms", (int)renderer->mTriangles, (int)renderer->mDrawCalls, submitTime);
+			ImGui::Text("Bone palettes: %d KB/frame, %d waits for the GPU", (int)(renderer->mBones.size() * sizeof(glm::vec4) >> 10), (int)renderer->mBoneBuffer.mWaits);
 			ImGui::Text("Name: %s", selectedModel->mName.c_str());
 			ImGui::Text("Model: c=%s, s=%s | length=%f",
 				glm::to_string(selectedModel->mAABB.mCenter).c_str(),
 				glm::to_string(selectedModel->mAABB.mHalfSize).c_str(),
 				glm::length(selectedModel->mAABB.mHalfSize) * 2.0f
 			);
+			const auto meshStats = selectedModel->GetMeshStats();
+			ImGui::Text("Vertices: %d, %d -> %d bytes/vertex, VBO %d -> %d KB", (int)meshStats.mVertices,
+				(int)sizeof(Vertex), meshStats.mVertices ? (int)(meshStats.mPackedBytes / meshStats.mVertices) : 0,
+				(int)(meshStats.mBytes >> 10), (int)(meshStats.mPackedBytes >> 10));
+			ImGui::Text("Indices: %d, IBO %d -> %d KB, %d meshes in %d nodes", (int)meshStats.mIndices,
+				(int)(meshStats.mIndexBytes >> 10), (int)(meshStats.mShortIndexBytes >> 10), (int)meshStats.mMeshes, (int)meshStats.mInstances);
+			std::vector<size_t> lodTriangles;
+			selectedModel->mRootNode->Recurse([&lodTriangles](ModelNode& node) {
+				for (const auto& mesh : node.mMeshes) {
+					if (lodTriangles.size() < mesh->GetLodCount()) lodTriangles.resize(mesh->GetLodCount(), 0);
+					for (size_t level = 0; level < lodTriangles.size(); ++level) {
+						lodTriangles[level] += mesh->GetLod(level).mNumIndices / 3;
+					}
+				}
+			});
+			std::string lodText = "LOD triangles:";
+			for (const auto triangles : lodTriangles) lodText += " " + std::to_string(triangles);
+			ImGui::Text("%s", lodText.c_str());
 
 			if(ImGui::SliderFloat3("Light Pos", &lightPos[0], -100, 100)) {
 				glUniform3fv(uLightPos, 1, (GLfloat*)&lightPos[0]);
@@ -234,8 +283,9 @@ int main(const int argc, const char **argv) {
 				ImGui::SliderFloat("Time", &animTime, 0.0f, anim->mDuration);
 				if(animWeightBonesTest[animIndex]) {
 					auto& disabledBones = ac->mDisabledBones[animIndex];
-					auto disableNode = [&disabledBones](auto& node, auto& self) -> void {
-						if(node->mCachedBoneIndex >= 0) disabledBones[node->mCachedBoneIndex] = !disabledBones[node->mCachedBoneIndex];
+					auto disableNode = [&disabledBones, &as](auto& node, auto& self) -> void {
+						const auto boneIndex = as->GetBoneIndex(node->mName);
+						if(boneIndex != -1) disabledBones.Toggle(boneIndex);
 						for(auto& child : node->mChildren) self(child, self);
 					};
 					auto nodes = [&disableNode](auto& node, auto& self) -> void {
@@ -249,18 +299,33 @@ int main(const int argc, const char **argv) {
 					};
 					nodes(as->mRootNode, nodes);
 					for(const auto& [boneName, boneIndex] : as->mBoneMappings) {
-						ImGui::Checkbox(boneName.c_str(), &disabledBones[boneIndex]);
+						bool disabled = disabledBones.Test(boneIndex);
+						if(ImGui::Checkbox(boneName.c_str(), &disabled)) {
+							disabledBones.Set(boneIndex, disabled);
+						}
 					}
 				}
 				if(animTracksBonesTest[animIndex]) {
-					for(auto& track : anim->mAnimationTracks) {
-						ImGui::LabelText(track->mName.c_str(), "P:%d R:%d S:%d", track->mPositionKeys.size(), track->mRotationKeys.size(), track->mScalingKeys.size());
+					if(anim->mCompressed) {
+						const auto& stats = anim->mCompressed->mStats;
+						ImGui::Text("Compressed: %d -> %d bytes, max error %f", (int)stats.mBytesBefore, (int)stats.mBytesAfter, stats.mMaxError);
+						for(size_t trackIndex = 0; trackIndex < anim->mAnimationTracks.size(); ++trackIndex) {
+							const auto& track = anim->mCompressed->mTracks[trackIndex];
+							ImGui::LabelText(anim->mAnimationTracks[trackIndex]->mName.c_str(), "P:%d R:%d S:%d", track.mPosition.mCount, track.mRotation.mCount, track.mScaling.mCount);
+						}
+					} else {
+						for(auto& track : anim->mAnimationTracks) {
+							ImGui::LabelText(track->mName.c_str(), "P:%d R:%d S:%d", track->mPositionKeys.size(), track->mRotationKeys.size(), track->mScalingKeys.size());
+						}
 					}
 				}
 				ImGui::PopID();
 			}
 
 			ImGui::Text("Application average %.3f ms/frame (%.1f FPS)", 1000.0f / ImGui::GetIO().Framerate, ImGui::GetIO().Framerate);
+			if (maxFrameTime > 0.0) {
+				ImGui::Text("Max frame time while streaming %.3f ms", maxFrameTime);
+			}
 			ImGui::End();
 		}
 
@@ -268,21 +333,25 @@ int main(const int argc, const char **argv) {
 		glUniformMatrix4fv(uniformView, 1, GL_FALSE, (GLfloat*)&cam.mView[0]);
 		glUniform3fv(uViewPos, 1, (GLfloat*)&cam.mPos[0]);
 
+		const double submitStart = glfwGetTime();
+		renderer->Begin(cam, (float)windowHeight);
 		for (auto& entity : scene->mEntities) {
 			const auto& model = entity->mModel;
 			if (!model) continue;
-			if (entity->mAnimationController) {
-				const auto& bones = entity->mAnimationController->mFinalTransforms;
-				glUniformMatrix4fv(uniformBones, bones.size(), GL_FALSE, (GLfloat*)&bones[0]);
-			}
 			glm::mat4 transform = glm::translate(glm::identity<glm::mat4>(), entity->mPos);
 			transform *= glm::mat4_cast(entity->mRot);
 			transform = glm::scale(transform, entity->mScale);
-			RenderNode(uniformModel, model->mRootNode, transform);
+			if (model->mStreaming) {
+				gDebugOverlay->AddBox(transform, model->mAABB, { 0.5f, 0.5f, 0.5f });
+				continue;
+			}
+			renderer->Add(*model, Affine::FromMat4(transform), entity->mAnimationController.get());
 			if((debugSkeleton || debugNodes) && entity->mAnimationController) {
-				RenderSkeleton(entity->mModel, entity->mAnimationController, timer.mTime, transform, debugNodes, debugSkeleton);
+				RenderSkeleton(*entity->mAnimationController, transform, debugNodes, debugSkeleton);
 			}
 		}
+		renderer->Render();
+		submitTime = (glfwGetTime() - submitStart) * 1000.0;
 
 		gDebugOverlay->Render(cam);
 		gDebugOverlay->Clear();
@@ -290,6 +359,8 @@ int main(const int argc, const char **argv) {
 		ui->Render();
 	}
 
+	uploader.reset();
+	renderer.reset();
 	scene.reset();
 	program.reset();
 
@@ -1,21 +1,124 @@
 #pragma once
 
-#include "Main.h"
 #include "Vertex.h"
 #include "AABB.h"
 
+// Level of detail, a range of the index buffer drawn instead of the full mesh.
+struct MeshLod {
+	uint32_t mFirstIndex = 0;
+	uint32_t mNumIndices = 0;
+	float mError = 0.0f; // Largest distance the surface moved, relative to the mesh AABB diagonal
+};
+
+// Screen space error in pixels up to which a coarser level is drawn, see Mesh::SelectLod
+#define MESH_LOD_PIXEL_ERROR 1.0f
+
 struct Mesh {
 	std::vector<Vertex> mVertices;
 	std::vector<uint32_t> mIndices;
+	std::vector<PackedVertex> mPackedVertices; // Uploaded instead of the vertices when not empty, see Pack
+	std::vector<MeshLod> mLods; // Finest first, all in mIndices. Empty when the mesh has a single level
+	Span<const Vertex> mMappedVertices; // Used instead of mVertices, mIndices and mPackedVertices when mMapping is set
+	Span<const uint32_t> mMappedIndices;
+	Span<const PackedVertex> mMappedPackedVertices;
+	Span<const MeshLod> mMappedLods;
+	std::shared_ptr<const void> mMapping; // Keeps the memory behind the mapped spans alive, see ModelCache.h
+	bool mHidden = false;
+	AABB mAABB;
+#ifndef HEADLESS
 	GLuint mVertexBuffer = 0;
 	GLuint mIndexBuffer = 0;
 	GLuint mVertexArray = 0;
-	bool mHidden = false;
-	AABB mAABB;
+	int mGeometryPool = -1; // Suballocated from GeometryBuffer instead of the buffers above
+	uint32_t mBaseVertex = 0;
+	uint32_t mBaseIndex = 0;
+#endif
 
 	Mesh(const Mesh&) = delete;
 	Mesh& operator=(const Mesh&) = delete;
 	Mesh() {}
+	Span<const Vertex> GetVertices() const {
+		return mMapping ? mMappedVertices : Span<const Vertex>(mVertices.data(), mVertices.size());
+	}
+	Span<const uint32_t> GetIndices() const {
+		return mMapping ? mMappedIndices : Span<const uint32_t>(mIndices.data(), mIndices.size());
+	}
+	Span<const PackedVertex> GetPackedVertices() const {
+		return mMapping ? mMappedPackedVertices : Span<const PackedVertex>(mPackedVertices.data(), mPackedVertices.size());
+	}
+	Span<const MeshLod> GetLods() const {
+		return mMapping ? mMappedLods : Span<const MeshLod>(mLods.data(), mLods.size());
+	}
+	size_t GetLodCount() const {
+		return std::max<size_t>(GetLods().size(), 1);
+	}
+	MeshLod GetLod(const size_t level) const {
+		const auto lods = GetLods();
+		if (lods.empty()) return { 0, (uint32_t)GetIndices().size(), 0.0f };
+		return lods[std::min(level, lods.size() - 1)];
+	}
+	Span<const uint32_t> GetLodIndices(const size_t level) const {
+		const auto lod = GetLod(level);
+		return { GetIndices().data() + lod.mFirstIndex, lod.mNumIndices };
+	}
+	// Coarsest level whose error stays below MESH_LOD_PIXEL_ERROR when the AABB diagonal
+	// covers screenSize pixels.
+	size_t SelectLod(const float screenSize) const {
+		const auto lods = GetLods();
+		for (size_t level = lods.size(); level-- > 1;) {
+			if (lods[level].mError * screenSize <= MESH_LOD_PIXEL_ERROR) return level;
+		}
+		return 0;
+	}
+	bool IsPacked() const {
+		return GetPackedVertices().size() > 0;
+	}
+	void UpdateAABB() {
+		mAABB = AABB::FromVertices(GetVertices());
+	}
+	// Quantizes the vertices into mPackedVertices relative to the mesh AABB, not for mapped meshes.
+	void Pack() {
+		UpdateAABB();
+		const auto vertices = GetVertices();
+		mPackedVertices.resize(vertices.size());
+		for (size_t i = 0; i < vertices.size(); ++i) {
+			mPackedVertices[i] = PackedVertex::Pack(vertices[i], mAABB.GetMin(), mAABB.mHalfSize * 2.0f);
+		}
+	}
+	// Decodes packed positions in the shader, identity for float vertices.
+	glm::vec3 GetPositionOffset() const {
+		return IsPacked() ? mAABB.GetMin() : glm::vec3(0.0f);
+	}
+	glm::vec3 GetPositionScale() const {
+		return IsPacked() ? mAABB.mHalfSize * 2.0f : glm::vec3(1.0f);
+	}
+	const void* GetVertexBufferData() const {
+		return IsPacked() ? (const void*)GetPackedVertices().data() : (const void*)GetVertices().data();
+	}
+	size_t GetVertexBufferSize() const {
+		return IsPacked() ? GetPackedVertices().size() * sizeof(PackedVertex) : GetVertices().size() * sizeof(Vertex);
+	}
+	// Indices stay 32-bit on the CPU, the index buffer uses 16 bits when every vertex fits.
+	bool HasShortIndices() const {
+		return GetVertices().size() < 65536;
+	}
+	size_t GetIndexSize() const {
+		return HasShortIndices() ? sizeof(uint16_t) : sizeof(uint32_t);
+	}
+	size_t GetIndexBufferSize() const {
+		return GetIndices().size() * GetIndexSize();
+	}
+	// Copies count indices from first on in the index buffer format.
+	void CopyIndexBufferData(void* destination, const size_t first, const size_t count) const {
+		const auto indices = GetIndices();
+		if (HasShortIndices()) {
+			auto shortIndices = (uint16_t*)destination;
+			for (size_t i = 0; i < count; ++i) shortIndices[i] = (uint16_t)indices[first + i];
+		} else {
+			std::memcpy(destination, indices.data() + first, count * sizeof(uint32_t));
+		}
+	}
+#ifndef HEADLESS
 	~Mesh() {
 		if (mVertexBuffer) glDeleteBuffers(1, &mVertexBuffer);
 		if (mIndexBuffer) glDeleteBuffers(1, &mIndexBuffer);
@@ -34,28 +137,45 @@ struct Mesh {
 		glBindVertexArray(mVertexArray);
 		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mIndexBuffer);
 	}
+	// Allocates both buffers without data, for MeshUploader to fill in.
+	void CreateBuffers() {
+		if (!mVertexBuffer) glGenBuffers(1, &mVertexBuffer);
+		if (!mIndexBuffer) glGenBuffers(1, &mIndexBuffer);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, mVertexBuffer);
+		glBufferData(GL_COPY_WRITE_BUFFER, GetVertexBufferSize(), nullptr, GL_STATIC_DRAW);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, mIndexBuffer);
+		glBufferData(GL_COPY_WRITE_BUFFER, GetIndexBufferSize(), nullptr, GL_STATIC_DRAW);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	}
 	void UpdateVertexBuffer() {
 		if (!mVertexBuffer) glGenBuffers(1, &mVertexBuffer);
 		glBindBuffer(GL_ARRAY_BUFFER, mVertexBuffer);
-		glBufferData(GL_ARRAY_BUFFER, mVertices.size() * sizeof(Vertex), &mVertices[0], GL_STATIC_DRAW);
+		glBufferData(GL_ARRAY_BUFFER, GetVertexBufferSize(), GetVertexBufferData(), GL_STATIC_DRAW);
 		glBindBuffer(GL_ARRAY_BUFFER, 0);
 	}
+	GLenum GetIndexType() const {
+		return HasShortIndices() ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+	}
 	void UpdateVertexArray() {
 		if (!mVertexArray) glGenVertexArrays(1, &mVertexArray);
 		glBindVertexArray(mVertexArray);
 		glBindBuffer(GL_ARRAY_BUFFER, mVertexBuffer);
-		Vertex::MapVertexArray();
+		if (IsPacked()) {
+			PackedVertex::MapVertexArray();
+		} else {
+			Vertex::MapVertexArray();
+		}
 		glBindVertexArray(0);
 		glBindBuffer(GL_ARRAY_BUFFER, 0);
 	}
 	void UpdateIndexBuffer() {
 		if (!mIndexBuffer) glGenBuffers(1, &mIndexBuffer);
 		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mIndexBuffer);
-		glBufferData(GL_ELEMENT_ARRAY_BUFFER, mIndices.size() * sizeof(uint32_t), &mIndices[0], GL_STATIC_DRAW);
+		std::vector<uint8_t> data(GetIndexBufferSize());
+		CopyIndexBufferData(data.data(), 0, GetIndices().size());
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, data.size(), data.data(), GL_STATIC_DRAW);
 		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
 	}
-	void UpdateAABB() {
-		mAABB = AABB::FromVertices(mVertices);
-	}
+#endif
 };
 typedef std::shared_ptr<Mesh> Mesh_;
@@ -0,0 +1,206 @@
+#include "MeshOptimizer.h"
+
+VertexCacheStats AnalyzeVertexCache(const uint32_t* indices, const size_t numIndices, const size_t numVertices, const size_t cacheSize) {
+	VertexCacheStats stats;
+	stats.mTriangles = numIndices / 3;
+	// A vertex is in the cache while fewer than cacheSize vertices were added after it
+	std::vector<size_t> addedAt(numVertices, 0);
+	std::vector<bool> referenced(numVertices, false);
+	size_t time = cacheSize + 1;
+	for (size_t i = 0; i < numIndices; ++i) {
+		const auto index = indices[i];
+		if (index >= numVertices) continue;
+		if (!referenced[index]) {
+			referenced[index] = true;
+			stats.mVertices++;
+		}
+		if (time - addedAt[index] > cacheSize) {
+			addedAt[index] = time++;
+			stats.mTransforms++;
+		}
+	}
+	stats.mACMR = stats.mTriangles ? (float)stats.mTransforms / stats.mTriangles : 0.0f;
+	stats.mATVR = stats.mVertices ? (float)stats.mTransforms / stats.mVertices : 0.0f;
+	return stats;
+}
+
+#define FORSYTH_CACHE_SIZE 32
+
+// Vertices in the cache score by position, the last triangle's three vertices score the same
+// so its vertices are preferred without favoring one of them. Vertices with few remaining
+// triangles score higher so they are finished off and leave the cache.
+float GetForsythScore(const int cachePosition, const uint32_t remainingTriangles) {
+	if (remainingTriangles == 0) return -1.0f;
+	float score = 0.0f;
+	if (cachePosition >= 0) {
+		if (cachePosition < 3) {
+			score = 0.75f;
+		} else {
+			score = std::pow(1.0f - (cachePosition - 3) / (float)(FORSYTH_CACHE_SIZE - 3), 1.5f);
+		}
+	}
+	return score + 2.0f / std::sqrt((float)remainingTriangles);
+}
+
+void OptimizeVertexCache(std::vector<uint32_t>& indices, const size_t numVertices) {
+	const size_t numTriangles = indices.size() / 3;
+	if (numTriangles == 0) return;
+
+	// Triangles of every vertex
+	std::vector<uint32_t> offsets(numVertices + 1, 0);
+	for (const auto index : indices) offsets[index + 1]++;
+	for (size_t v = 0; v < numVertices; ++v) offsets[v + 1] += offsets[v];
+	std::vector<uint32_t> vertexTriangles(indices.size());
+	std::vector<uint32_t> remaining(numVertices, 0);
+	for (size_t t = 0; t < numTriangles; ++t) {
+		for (size_t k = 0; k < 3; ++k) {
+			const auto v = indices[t * 3 + k];
+			vertexTriangles[offsets[v] + remaining[v]++] = (uint32_t)t;
+		}
+	}
+
+	std::vector<int> cachePositions(numVertices, -1);
+	std::vector<float> vertexScores(numVertices);
+	for (size_t v = 0; v < numVertices; ++v) {
+		vertexScores[v] = GetForsythScore(-1, remaining[v]);
+	}
+	std::vector<float> triangleScores(numTriangles);
+	for (size_t t = 0; t < numTriangles; ++t) {
+		triangleScores[t] = vertexScores[indices[t * 3]] + vertexScores[indices[t * 3 + 1]] + vertexScores[indices[t * 3 + 2]];
+	}
+	std::vector<bool> emitted(numTriangles, false);
+
+	std::vector<uint32_t> result;
+	result.reserve(indices.size());
+	std::vector<uint32_t> cache, nextCache;
+	cache.reserve(FORSYTH_CACHE_SIZE + 3);
+	nextCache.reserve(FORSYTH_CACHE_SIZE + 3);
+	size_t nextUnemitted = 0;
+	int64_t best = -1;
+	for (size_t t = 0; t < numTriangles; ++t) {
+		if (best < 0 || triangleScores[t] > triangleScores[best]) best = t;
+	}
+
+	while (best >= 0) {
+		emitted[best] = true;
+		const uint32_t* triangle = &indices[best * 3];
+		nextCache.assign(triangle, triangle + 3);
+		for (size_t k = 0; k < 3; ++k) {
+			const auto v = triangle[k];
+			result.push_back(v);
+			// Remove the triangle from the vertex's list of remaining triangles
+			auto begin = vertexTriangles.begin() + offsets[v];
+			auto end = begin + remaining[v];
+			std::iter_swap(std::find(begin, end, (uint32_t)best), end - 1);
+			remaining[v]--;
+		}
+		for (const auto v : cache) {
+			if (v != triangle[0] && v != triangle[1] && v != triangle[2]) nextCache.push_back(v);
+		}
+		for (size_t i = FORSYTH_CACHE_SIZE; i < nextCache.size(); ++i) {
+			cachePositions[nextCache[i]] = -1;
+			vertexScores[nextCache[i]] = GetForsythScore(-1, remaining[nextCache[i]]);
+		}
+		if (nextCache.size() > FORSYTH_CACHE_SIZE) nextCache.resize(FORSYTH_CACHE_SIZE);
+		std::swap(cache, nextCache);
+		for (size_t i = 0; i < cache.size(); ++i) {
+			cachePositions[cache[i]] = (int)i;
+			vertexScores[cache[i]] = GetForsythScore((int)i, remaining[cache[i]]);
+		}
+
+		// Only triangles touching the cache changed their score
+		best = -1;
+		float bestScore = -1.0f;
+		for (const auto v : cache) {
+			for (uint32_t i = 0; i < remaining[v]; ++i) {
+				const auto t = vertexTriangles[offsets[v] + i];
+				const float score = vertexScores[indices[t * 3]] + vertexScores[indices[t * 3 + 1]] + vertexScores[indices[t * 3 + 2]];
+				triangleScores[t] = score;
+				if (score > bestScore) {
+					bestScore = score;
+					best = t;
+				}
+			}
+		}
+		if (best < 0) {
+			// Nothing left around the cache, continue with the next triangle in input order
+			while (nextUnemitted < numTriangles && emitted[nextUnemitted]) nextUnemitted++;
+			if (nextUnemitted < numTriangles) best = nextUnemitted;
+		}
+	}
+	indices = std::move(result);
+}
+
+void OptimizeOverdraw(std::vector<uint32_t>& indices, const std::vector<Vertex>& vertices) {
+	const size_t numTriangles = indices.size() / 3;
+	if (numTriangles == 0) return;
+
+	// A cluster starts with every triangle that misses the cache on all three vertices
+	std::vector<size_t> clusters;
+	std::vector<size_t> addedAt(vertices.size(), 0);
+	size_t time = VERTEX_CACHE_SIZE + 1;
+	for (size_t t = 0; t < numTriangles; ++t) {
+		size_t misses = 0;
+		for (size_t k = 0; k < 3; ++k) {
+			const auto v = indices[t * 3 + k];
+			if (time - addedAt[v] > VERTEX_CACHE_SIZE) {
+				addedAt[v] = time++;
+				misses++;
+			}
+		}
+		if (misses == 3) clusters.push_back(t);
+	}
+	clusters.push_back(numTriangles);
+
+	glm::vec3 meshCenter = { 0, 0, 0 };
+	for (const auto& vertex : vertices) meshCenter += vertex.mPos;
+	meshCenter /= (float)std::max<size_t>(vertices.size(), 1);
+
+	// Clusters facing away from the center are likely in front of the others
+	std::vector<std::pair<float, size_t>> order;
+	for (size_t c = 0; c + 1 < clusters.size(); ++c) {
+		glm::vec3 center = { 0, 0, 0 };
+		glm::vec3 normal = { 0, 0, 0 };
+		float area = 0.0f;
+		for (size_t t = clusters[c]; t < clusters[c + 1]; ++t) {
+			const auto& a = vertices[indices[t * 3]].mPos;
+			const auto& b = vertices[indices[t * 3 + 1]].mPos;
+			const auto& d = vertices[indices[t * 3 + 2]].mPos;
+			const auto cross = glm::cross(b - a, d - a);
+			const float triangleArea = glm::length(cross);
+			center += (a + b + d) / 3.0f * triangleArea;
+			normal += cross;
+			area += triangleArea;
+		}
+		if (area > 0.0f) center /= area;
+		const float length = glm::length(normal);
+		const float facing = length > 0.0f ? glm::dot(center - meshCenter, normal / length) : 0.0f;
+		order.push_back({ -facing, c });
+	}
+	std::stable_sort(order.begin(), order.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+
+	std::vector<uint32_t> result;
+	result.reserve(indices.size());
+	for (const auto& [facing, c] : order) {
+		result.insert(result.end(), indices.begin() + clusters[c] * 3, indices.begin() + clusters[c + 1] * 3);
+	}
+	indices = std::move(result);
+}
+
+void OptimizeVertexFetch(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices) {
+	const uint32_t unused = std::numeric_limits<uint32_t>::max();
+	std::vector<uint32_t> remap(vertices.size(), unused);
+	std::vector<Vertex> result;
+	result.reserve(vertices.size());
+	for (auto& index : indices) {
+		if (remap[index] == unused) {
+			remap[index] = (uint32_t)result.size();
+			result.push_back(vertices[index]);
+		}
+		index = remap[index];
+	}
+	for (size_t v = 0; v < vertices.size(); ++v) {
+		if (remap[v] == unused) result.push_back(vertices[v]);
+	}
+	vertices = std::move(result);
+}
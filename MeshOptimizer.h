@@ -0,0 +1,34 @@
+#pragma once
+
+#include "Vertex.h"
+
+// Import time reordering of triangle lists for the GPU. Skinned vertices are expensive to
+// transform, so every post-transform cache miss costs four bone matrices.
+
+// Cache size used by AnalyzeVertexCache unless told otherwise, a common size for the
+// post-transform cache of current GPUs.
+#define VERTEX_CACHE_SIZE 16
+
+struct VertexCacheStats {
+	size_t mTriangles = 0;
+	size_t mVertices = 0; // Referenced by at least one triangle
+	size_t mTransforms = 0; // Cache misses
+	float mACMR = 0.0f; // Average cache miss ratio, transforms per triangle, 0.5 at best
+	float mATVR = 0.0f; // Average transform to vertex ratio, 1 at best
+};
+
+// Simulates a FIFO post-transform cache of cacheSize entries over the index buffer.
+VertexCacheStats AnalyzeVertexCache(const uint32_t* indices, size_t numIndices, size_t numVertices, size_t cacheSize = VERTEX_CACHE_SIZE);
+
+// Reorders triangles to reuse recently transformed vertices (Forsyth, "Linear-Speed Vertex
+// Cache Optimisation"). Works for any cache size, best for LRU caches around 32 entries.
+void OptimizeVertexCache(std::vector<uint32_t>& indices, size_t numVertices);
+
+// Reorders clusters of triangles so those facing away from the mesh center are drawn first
+// and occlude the rest. Clusters split where the vertex cache order starts over, so the
+// vertex cache order is kept within clusters. Run after OptimizeVertexCache.
+void OptimizeOverdraw(std::vector<uint32_t>& indices, const std::vector<Vertex>& vertices);
+
+// Reorders vertices by first use in the index buffer so vertex fetches move through memory
+// linearly, and remaps the indices. Unreferenced vertices are moved to the end.
+void OptimizeVertexFetch(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices);
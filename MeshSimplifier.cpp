@@ -0,0 +1,178 @@
+#include "MeshSimplifier.h"
+
+// Sum of squared distances to a set of planes, as a symmetric 4x4 matrix
+struct Quadric {
+	double mA00 = 0, mA01 = 0, mA02 = 0, mA11 = 0, mA12 = 0, mA22 = 0;
+	double mB0 = 0, mB1 = 0, mB2 = 0;
+	double mC = 0;
+
+	void AddPlane(const glm::vec3& normal, const float distance) {
+		const double a = normal.x, b = normal.y, c = normal.z, d = distance;
+		mA00 += a * a; mA01 += a * b; mA02 += a * c;
+		mA11 += b * b; mA12 += b * c; mA22 += c * c;
+		mB0 += a * d; mB1 += b * d; mB2 += c * d;
+		mC += d * d;
+	}
+
+	void Add(const Quadric& q) {
+		mA00 += q.mA00; mA01 += q.mA01; mA02 += q.mA02;
+		mA11 += q.mA11; mA12 += q.mA12; mA22 += q.mA22;
+		mB0 += q.mB0; mB1 += q.mB1; mB2 += q.mB2;
+		mC += q.mC;
+	}
+
+	double Evaluate(const glm::vec3& p) const {
+		const double x = p.x, y = p.y, z = p.z;
+		const double result = mA00 * x * x + 2 * mA01 * x * y + 2 * mA02 * x * z
+			+ mA11 * y * y + 2 * mA12 * y * z + mA22 * z * z
+			+ 2 * (mB0 * x + mB1 * y + mB2 * z) + mC;
+		return std::max(result, 0.0);
+	}
+};
+
+struct Collapse {
+	uint32_t mFrom;
+	uint32_t mTo;
+	double mCost;
+};
+
+float GetBoneWeightDistance(const Vertex& a, const Vertex& b) {
+	float distance = 0.0f;
+	for (size_t i = 0; i < MAX_VERTEX_WEIGHTS; ++i) {
+		float weight = 0.0f;
+		for (size_t k = 0; k < MAX_VERTEX_WEIGHTS; ++k) {
+			if (b.mBoneWeights[k] > 0.0f && b.mBoneIndices[k] == a.mBoneIndices[i]) weight += b.mBoneWeights[k];
+		}
+		distance += std::abs(a.mBoneWeights[i] - weight);
+	}
+	for (size_t k = 0; k < MAX_VERTEX_WEIGHTS; ++k) {
+		bool shared = false;
+		for (size_t i = 0; i < MAX_VERTEX_WEIGHTS; ++i) {
+			shared = shared || (a.mBoneWeights[i] > 0.0f && a.mBoneIndices[i] == b.mBoneIndices[k]);
+		}
+		if (!shared) distance += b.mBoneWeights[k];
+	}
+	return distance;
+}
+
+// Collapsing from onto to must not turn any remaining triangle around from upside down.
+bool FlipsTriangle(const std::vector<Vertex>& vertices, const uint32_t* triangles, const uint32_t* begin, const uint32_t* end, const uint32_t from, const uint32_t to) {
+	for (auto t = begin; t != end; ++t) {
+		const uint32_t* triangle = &triangles[*t * 3];
+		if (triangle[0] == to || triangle[1] == to || triangle[2] == to) continue;
+		glm::vec3 before[3], after[3];
+		for (size_t k = 0; k < 3; ++k) {
+			before[k] = vertices[triangle[k]].mPos;
+			after[k] = triangle[k] == from ? vertices[to].mPos : before[k];
+		}
+		const auto normalBefore = glm::cross(before[1] - before[0], before[2] - before[0]);
+		const auto normalAfter = glm::cross(after[1] - after[0], after[2] - after[0]);
+		if (glm::dot(normalBefore, normalAfter) <= 0.0f) return true;
+	}
+	return false;
+}
+
+std::vector<uint32_t> SimplifyMesh(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices, const size_t targetIndexCount, const float maxError, float* error) {
+	const size_t numVertices = vertices.size();
+	std::vector<uint32_t> result = indices;
+	if (error) *error = 0.0f;
+
+	// Seams: several vertices at the same position
+	std::vector<bool> locked(numVertices, false);
+	std::map<std::tuple<float, float, float>, uint32_t> positions;
+	for (uint32_t v = 0; v < numVertices; ++v) {
+		const auto& p = vertices[v].mPos;
+		const auto [it, added] = positions.emplace(std::make_tuple(p.x, p.y, p.z), v);
+		if (!added) locked[v] = locked[it->second] = true;
+	}
+	// Borders: edges used by a single triangle
+	std::map<std::pair<uint32_t, uint32_t>, uint32_t> edgeCounts;
+	for (size_t i = 0; i < result.size(); i += 3) {
+		for (size_t k = 0; k < 3; ++k) {
+			const auto a = result[i + k], b = result[i + (k + 1) % 3];
+			edgeCounts[{ std::min(a, b), std::max(a, b) }]++;
+		}
+	}
+	for (const auto& [edge, count] : edgeCounts) {
+		if (count == 1) locked[edge.first] = locked[edge.second] = true;
+	}
+
+	std::vector<Quadric> quadrics(numVertices);
+	for (size_t i = 0; i < result.size(); i += 3) {
+		const auto& a = vertices[result[i]].mPos;
+		const auto& b = vertices[result[i + 1]].mPos;
+		const auto& c = vertices[result[i + 2]].mPos;
+		const auto cross = glm::cross(b - a, c - a);
+		const float length = glm::length(cross);
+		if (length <= 0.0f) continue;
+		const auto normal = cross / length;
+		for (size_t k = 0; k < 3; ++k) {
+			quadrics[result[i + k]].AddPlane(normal, -glm::dot(normal, a));
+		}
+	}
+
+	const double maxCost = (double)maxError * maxError;
+	std::vector<uint32_t> offsets, vertexTriangles, counts;
+	std::vector<Collapse> collapses;
+	std::vector<uint32_t> remap(numVertices);
+	std::vector<bool> touched(numVertices);
+	while (result.size() > targetIndexCount) {
+		const size_t numTriangles = result.size() / 3;
+
+		// Triangles of every vertex
+		offsets.assign(numVertices + 1, 0);
+		for (const auto index : result) offsets[index + 1]++;
+		for (size_t v = 0; v < numVertices; ++v) offsets[v + 1] += offsets[v];
+		vertexTriangles.resize(result.size());
+		counts.assign(numVertices, 0);
+		for (size_t t = 0; t < numTriangles; ++t) {
+			for (size_t k = 0; k < 3; ++k) {
+				const auto v = result[t * 3 + k];
+				vertexTriangles[offsets[v] + counts[v]++] = (uint32_t)t;
+			}
+		}
+
+		collapses.clear();
+		for (size_t i = 0; i < result.size(); ++i) {
+			const auto from = result[i];
+			const auto to = result[i - i % 3 + (i + 1) % 3];
+			if (locked[from] || GetBoneWeightDistance(vertices[from], vertices[to]) > MESH_LOD_WEIGHT_TOLERANCE) continue;
+			Quadric quadric = quadrics[from];
+			quadric.Add(quadrics[to]);
+			collapses.push_back({ from, to, quadric.Evaluate(vertices[to].mPos) });
+		}
+		std::sort(collapses.begin(), collapses.end(), [](const Collapse& a, const Collapse& b) { return a.mCost < b.mCost; });
+
+		// Collapses in one pass must not share triangles, so their checks stay valid
+		const size_t maxCollapses = (numTriangles - targetIndexCount / 3) / 2 + 1;
+		size_t numCollapses = 0;
+		for (uint32_t v = 0; v < numVertices; ++v) remap[v] = v;
+		touched.assign(numVertices, false);
+		for (const auto& collapse : collapses) {
+			if (collapse.mCost > maxCost || numCollapses >= maxCollapses) break;
+			if (touched[collapse.mFrom] || touched[collapse.mTo]) continue;
+			const auto begin = &vertexTriangles[offsets[collapse.mFrom]];
+			const auto end = begin + counts[collapse.mFrom];
+			if (FlipsTriangle(vertices, result.data(), begin, end, collapse.mFrom, collapse.mTo)) continue;
+			for (auto t = begin; t != end; ++t) {
+				for (size_t k = 0; k < 3; ++k) touched[result[*t * 3 + k]] = true;
+			}
+			remap[collapse.mFrom] = collapse.mTo;
+			quadrics[collapse.mTo].Add(quadrics[collapse.mFrom]);
+			if (error) *error = std::max(*error, (float)std::sqrt(collapse.mCost));
+			numCollapses++;
+		}
+		if (numCollapses == 0) break;
+
+		size_t count = 0;
+		for (size_t i = 0; i < result.size(); i += 3) {
+			const auto a = remap[result[i]], b = remap[result[i + 1]], c = remap[result[i + 2]];
+			if (a == b || b == c || c == a) continue;
+			result[count++] = a;
+			result[count++] = b;
+			result[count++] = c;
+		}
+		result.resize(count);
+	}
+	return result;
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+#include "Vertex.h"
+
+// Vertices whose bone weights differ by more than this (sum of absolute differences,
+// 0 to 2) are never merged, so simplified meshes still bend at the same joints.
+#define MESH_LOD_WEIGHT_TOLERANCE 0.25f
+
+// Quadric error edge collapse (Garland and Heckbert) that moves vertices onto one of their
+// neighbours instead of creating new ones, so the result indexes the original vertices and
+// keeps their bone weights. Vertices on open borders and UV/normal seams stay in place.
+// Collapses until at most targetIndexCount indices are left or the next collapse would
+// move the surface by more than maxError. Returns the new indices, error receives the
+// largest distance the surface moved.
+std::vector<uint32_t> SimplifyMesh(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices, size_t targetIndexCount, float maxError, float* error = nullptr);
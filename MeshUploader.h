@@ -0,0 +1,137 @@
+#pragma once
+
+#include "Model.h"
+#include "GeometryBuffer.h"
+
+#include <deque>
+
+// Uploads streamed models to the GPU spread over several frames. Every Update writes at
+// most mBudget bytes of vertices and indices into a staging buffer, which is orphaned
+// each frame so the driver never waits for last frame's copies, and copies them into
+// the mesh buffers on the GPU, or into their ranges of mGeometry when it is set. Models
+// are uploaded in the order they were added.
+struct MeshUploader {
+	struct Upload {
+		Model_ mModel;
+		std::vector<Mesh*> mMeshes;
+		size_t mMesh = 0;
+		size_t mOffset = 0; // Bytes of the current mesh already staged, vertices then indices
+	};
+	struct Copy {
+		const GLuint* mBuffer; // Read when the copy is issued, GeometryBuffer may replace a pool's buffers while staging
+		size_t mSource;
+		size_t mDestination;
+		size_t mSize;
+	};
+	std::deque<Upload> mUploads;
+	std::vector<Copy> mCopies;
+	GLuint mStagingBuffer = 0;
+	size_t mBudget;
+	GeometryBuffer* mGeometry = nullptr;
+	size_t mFrameBytes = 0; // Uploaded by the last Update
+	size_t mTotalBytes = 0;
+
+	MeshUploader(const size_t budget, GeometryBuffer* geometry = nullptr) : mBudget(std::max<size_t>(budget, 64 << 10)), mGeometry(geometry) {}
+	MeshUploader(const MeshUploader&) = delete;
+	MeshUploader& operator=(const MeshUploader&) = delete;
+	~MeshUploader() {
+		if (mStagingBuffer) glDeleteBuffers(1, &mStagingBuffer);
+	}
+
+	// Marks the model as streaming until all of its meshes are uploaded.
+	void Add(const Model_& model) {
+		Upload upload;
+		upload.mModel = model;
+		model->mRootNode->Recurse([&upload](ModelNode& node) {
+			for (const auto& mesh : node.mMeshes) {
+				if (std::find(upload.mMeshes.begin(), upload.mMeshes.end(), mesh.get()) == upload.mMeshes.end()) {
+					upload.mMeshes.push_back(mesh.get());
+				}
+			}
+		});
+		model->mStreaming = true;
+		mUploads.push_back(std::move(upload));
+	}
+
+	bool IsIdle() const {
+		return mUploads.empty();
+	}
+
+	void Update() {
+		mFrameBytes = 0;
+		if (mUploads.empty()) return;
+		if (!mStagingBuffer) glGenBuffers(1, &mStagingBuffer);
+		glBindBuffer(GL_COPY_READ_BUFFER, mStagingBuffer);
+		glBufferData(GL_COPY_READ_BUFFER, mBudget, nullptr, GL_STREAM_DRAW);
+		auto staging = (uint8_t*)glMapBufferRange(GL_COPY_READ_BUFFER, 0, mBudget, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+		if (!staging) {
+			glBindBuffer(GL_COPY_READ_BUFFER, 0);
+			return;
+		}
+
+		mCopies.clear();
+		std::vector<Mesh*> finished;
+		while (mFrameBytes < mBudget && !mUploads.empty()) {
+			auto& upload = mUploads.front();
+			if (upload.mMesh == upload.mMeshes.size()) {
+				upload.mModel->mStreaming = false;
+				mUploads.pop_front();
+				continue;
+			}
+			auto mesh = upload.mMeshes[upload.mMesh];
+			if (upload.mOffset == 0) {
+				if (mGeometry) {
+					mGeometry->Allocate(*mesh);
+				} else {
+					mesh->CreateBuffers();
+				}
+			}
+			const size_t vertexBytes = mesh->GetVertexBufferSize();
+			const size_t indexBytes = mesh->GetIndexBufferSize();
+			const size_t indexSize = mesh->GetIndexSize();
+
+			// Indices are converted to the buffer format while staging, whole indices at a time
+			const bool vertexPart = upload.mOffset < vertexBytes;
+			const size_t offset = vertexPart ? upload.mOffset : upload.mOffset - vertexBytes;
+			const size_t partBytes = vertexPart ? vertexBytes : indexBytes;
+			size_t size = std::min(partBytes - offset, mBudget - mFrameBytes);
+			if (!vertexPart) size -= size % indexSize;
+			if (size == 0 && offset < partBytes) break;
+			if (size > 0) {
+				if (vertexPart) {
+					std::memcpy(staging + mFrameBytes, (const uint8_t*)mesh->GetVertexBufferData() + offset, size);
+				} else {
+					mesh->CopyIndexBufferData(staging + mFrameBytes, offset / indexSize, size / indexSize);
+				}
+				if (mGeometry) {
+					const auto& pool = mGeometry->mPools[mesh->mGeometryPool];
+					const size_t base = vertexPart ? mesh->mBaseVertex * pool.GetVertexSize() : mesh->mBaseIndex * pool.GetIndexSize();
+					mCopies.push_back({ vertexPart ? &pool.mVertexBuffer : &pool.mIndexBuffer, mFrameBytes, base + offset, size });
+				} else {
+					mCopies.push_back({ vertexPart ? &mesh->mVertexBuffer : &mesh->mIndexBuffer, mFrameBytes, offset, size });
+				}
+				mFrameBytes += size;
+				upload.mOffset += size;
+			}
+			if (upload.mOffset == vertexBytes + indexBytes) {
+				finished.push_back(mesh);
+				upload.mMesh++;
+				upload.mOffset = 0;
+			}
+		}
+		glUnmapBuffer(GL_COPY_READ_BUFFER);
+
+		for (const auto& copy : mCopies) {
+			glBindBuffer(GL_COPY_WRITE_BUFFER, *copy.mBuffer);
+			glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, copy.mSource, copy.mDestination, copy.mSize);
+		}
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+		glBindBuffer(GL_COPY_READ_BUFFER, 0);
+		if (!mGeometry) {
+			for (auto mesh : finished) {
+				mesh->UpdateVertexArray();
+			}
+		}
+		mTotalBytes += mFrameBytes;
+	}
+};
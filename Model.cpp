@@ -1,4 +1,11 @@
 #include "Model.h"
+#include "AnimationReduction.h"
+#include "ModelCache.h"
+#include "MeshOptimizer.h"
+#include "MeshSimplifier.h"
+
+#include <chrono>
+#include <unordered_set>
 
 #include <assimp/cimport.h>
 #include <assimp/scene.h>
@@ -53,60 +60,68 @@ void LoadBoneWeights(Model* model, Mesh_ mesh, const aiMesh* nodeMesh) {
     }
 }
 
-ModelNode_ LoadNode(Model* model, const aiScene* scene, const aiNode* node, ModelNode_ parent = nullptr) {
-    ModelNode_ modelNode = std::make_shared<ModelNode>(node->mName.data, parent, make_mat4(node->mTransformation));
+Mesh_ LoadMesh(Model* model, const aiMesh* nodeMesh, const unsigned int sceneIndex) {
+    auto mesh = std::make_shared<Mesh>();
+    auto debugColor = DebugColor(nodeMesh->mName.data, sceneIndex);
 
-    for (unsigned int meshIndex = 0; meshIndex < node->mNumMeshes; ++meshIndex) {
-        const auto nodeMesh = scene->mMeshes[node->mMeshes[meshIndex]]; // TODO: Shared meshes?
-        auto mesh = std::make_shared<Mesh>();
-        auto debugColor = RandomColor();
-
-        mesh->mVertices.resize(nodeMesh->mNumVertices);
-        auto vertexPointer = mesh->mVertices.data();
-        for (unsigned int vertexIndex = 0; vertexIndex < nodeMesh->mNumVertices; ++vertexIndex) {
-            const auto& nodeVertex = nodeMesh->mVertices[vertexIndex];
-            vertexPointer->mPos = make_vec3(nodeVertex);
-            if (nodeMesh->HasNormals()) {
-                vertexPointer->mNormal = make_vec3(nodeMesh->mNormals[vertexIndex]);
-            }
-            vertexPointer->mColor = debugColor; // FIXME
-            vertexPointer++;
+    mesh->mVertices.resize(nodeMesh->mNumVertices);
+    auto vertexPointer = mesh->mVertices.data();
+    for (unsigned int vertexIndex = 0; vertexIndex < nodeMesh->mNumVertices; ++vertexIndex) {
+        const auto& nodeVertex = nodeMesh->mVertices[vertexIndex];
+        vertexPointer->mPos = make_vec3(nodeVertex);
+        if (nodeMesh->HasNormals()) {
+            vertexPointer->mNormal = make_vec3(nodeMesh->mNormals[vertexIndex]);
         }
+        vertexPointer->mColor = debugColor; // FIXME
+        vertexPointer++;
+    }
 
-        mesh->mIndices.resize(nodeMesh->mNumFaces * 3);
-        auto indexPointer = mesh->mIndices.data();
-        size_t invalidFaces = 0;
-        for (unsigned int faceIndex = 0; faceIndex < nodeMesh->mNumFaces; ++faceIndex) {
-            const auto nodeFace = &nodeMesh->mFaces[faceIndex];
-            //assert(nodeFace->mNumIndices == 3);
-            if (nodeFace->mNumIndices != 3) {
-                invalidFaces++;
-                continue;
-            }
-            *indexPointer++ = nodeFace->mIndices[0];
-            *indexPointer++ = nodeFace->mIndices[1];
-            *indexPointer++ = nodeFace->mIndices[2];
+    mesh->mIndices.resize(nodeMesh->mNumFaces * 3);
+    auto indexPointer = mesh->mIndices.data();
+    size_t invalidFaces = 0;
+    for (unsigned int faceIndex = 0; faceIndex < nodeMesh->mNumFaces; ++faceIndex) {
+        const auto nodeFace = &nodeMesh->mFaces[faceIndex];
+        //assert(nodeFace->mNumIndices == 3);
+        if (nodeFace->mNumIndices != 3) {
+            invalidFaces++;
+            continue;
         }
+        *indexPointer++ = nodeFace->mIndices[0];
+        *indexPointer++ = nodeFace->mIndices[1];
+        *indexPointer++ = nodeFace->mIndices[2];
+    }
 
-        // FIXME
-        if (invalidFaces > 0) {
-            std::cerr << "Model has " << invalidFaces << " invalid (non triangular) faces" << std::endl;
-            while (invalidFaces > 0) {
-                mesh->mIndices.pop_back();
-                invalidFaces--;
-            }
+    // FIXME
+    if (invalidFaces > 0) {
+        std::cerr << "Model has " << invalidFaces << " invalid (non triangular) faces" << std::endl;
+        while (invalidFaces > 0) {
+            mesh->mIndices.pop_back();
+            invalidFaces--;
         }
+    }
 
-        // FIXME
-        if (model->mAnimationSet) {
-            LoadBoneWeights(model, mesh, nodeMesh);
-        }
+    // FIXME
+    if (model->mAnimationSet) {
+        LoadBoneWeights(model, mesh, nodeMesh);
+    }
+
+    return mesh;
+}
 
+// Nodes referencing the same aiMesh share one Mesh, meshes holds them by aiScene index.
+ModelNode_ LoadNode(Model* model, const aiScene* scene, const aiNode* node, std::vector<Mesh_>& meshes, ModelNode_ parent = nullptr) {
+    ModelNode_ modelNode = std::make_shared<ModelNode>(node->mName.data, parent, make_mat4(node->mTransformation));
+
+    for (unsigned int meshIndex = 0; meshIndex < node->mNumMeshes; ++meshIndex) {
+        auto& mesh = meshes[node->mMeshes[meshIndex]];
+        if (!mesh) {
+            mesh = LoadMesh(model, scene->mMeshes[node->mMeshes[meshIndex]], node->mMeshes[meshIndex]);
+        }
         modelNode->mMeshes.push_back(mesh);
     }
 
     for (unsigned int childIndex = 0; childIndex < node->mNumChildren; ++childIndex) {
-        auto childNode = LoadNode(model, scene, node->mChildren[childIndex], modelNode);
+        auto childNode = LoadNode(model, scene, node->mChildren[childIndex], meshes, modelNode);
         modelNode->mChildren.push_back(childNode);
     }
 
@@ -147,25 +162,112 @@ void LoadAnimations(Model* model, const aiScene* scene) {
 
             for (unsigned int i = 0; i < aChannel->mNumPositionKeys; ++i) {
                 const auto aKey = aChannel->mPositionKeys[i];
-                track->mPositionKeys.push_back(VectorKey((float)aKey.mTime, make_vec3(aKey.mValue)));
+                track->mPositionKeys.Add((float)aKey.mTime, make_vec3(aKey.mValue));
             }
             for (unsigned int i = 0; i < aChannel->mNumScalingKeys; ++i) {
                 const auto aKey = aChannel->mScalingKeys[i];
-                track->mScalingKeys.push_back(VectorKey((float)aKey.mTime, make_vec3(aKey.mValue)));
+                track->mScalingKeys.Add((float)aKey.mTime, make_vec3(aKey.mValue));
             }
             for (unsigned int i = 0; i < aChannel->mNumRotationKeys; ++i) {
                 const auto aKey = aChannel->mRotationKeys[i];
-                track->mRotationKeys.push_back(QuatKey((float)aKey.mTime, make_quat(aKey.mValue)));
+                track->mRotationKeys.Add((float)aKey.mTime, make_quat(aKey.mValue));
             }
 
             // TODO Pre/post state
             animation->mAnimationTracks.push_back(track);
         }
 
-        model->mAnimationSet->mAnimations.push_back(animation);
+        model->mAnimationSet->AddAnimation(animation);
+    }
+}
+
+void ReduceAnimations(Model* model, const size_t firstAnimation, const ModelOptions& options) {
+    const auto& animations = model->mAnimationSet->mAnimations;
+    if (!options.mReduceKeyFrames || firstAnimation >= animations.size()) return;
+    const auto tolerances = GetKeyFrameTolerances(model->mAnimationSet->mRootNode, options.mKeyFrameDistanceTolerance, options.mKeyFrameAngleTolerance);
+    const KeyFrameTolerance fallback = { options.mKeyFrameDistanceTolerance, options.mKeyFrameAngleTolerance, options.mKeyFrameDistanceTolerance };
+    for (size_t i = firstAnimation; i < animations.size(); ++i) {
+        const auto& animation = animations[i];
+        const auto stats = ReduceKeyFrames(*animation, tolerances, fallback);
+        std::cout << "Reduced animation " << animation->mName << ": " << stats.mKeysBefore << " -> " << stats.mKeysAfter << " keys"
+            << " (" << (100.0f * stats.mKeysAfter / std::max<size_t>(stats.mKeysBefore, 1)) << "%), " << stats.mConstantChannels << " constant channels" << std::endl;
     }
 }
 
+void CompressAnimations(Model* model) {
+    for (auto& animation : model->mAnimationSet->mAnimations) {
+        if (animation->mCompressed) continue;
+        auto compressed = CompressAnimation(*animation);
+        compressed->mStats = MeasureCompression(*model->mAnimationSet, *animation, *compressed);
+        const auto& stats = compressed->mStats;
+        std::cout << "Compressed animation " << animation->mName << ": " << stats.mBytesBefore << " -> " << stats.mBytesAfter << " bytes"
+            << " (" << (100.0f * stats.mBytesAfter / std::max<size_t>(stats.mBytesBefore, 1)) << "%), max joint error " << stats.mMaxError << std::endl;
+        animation->mCompressed = compressed;
+        for (auto& track : animation->mAnimationTracks) {
+            track->mPositionKeys = {};
+            track->mRotationKeys = {};
+            track->mScalingKeys = {};
+        }
+    }
+}
+
+void OptimizeMeshes(Model* model, const ModelOptions& options) {
+    if (!options.mOptimizeMeshes) return;
+    VertexCacheStats before, after;
+    std::unordered_set<Mesh*> meshes;
+    model->mRootNode->Recurse([&](ModelNode& node) {
+        for (auto& mesh : node.mMeshes) {
+            if (!meshes.insert(mesh.get()).second) continue;
+            const auto meshBefore = AnalyzeVertexCache(mesh->mIndices.data(), mesh->mIndices.size(), mesh->mVertices.size());
+            OptimizeVertexCache(mesh->mIndices, mesh->mVertices.size());
+            if (options.mOptimizeOverdraw) OptimizeOverdraw(mesh->mIndices, mesh->mVertices);
+            OptimizeVertexFetch(mesh->mVertices, mesh->mIndices);
+            const auto meshAfter = AnalyzeVertexCache(mesh->mIndices.data(), mesh->mIndices.size(), mesh->mVertices.size());
+            std::cout << "Optimized mesh of " << node.mName << ": " << meshBefore.mTriangles << " triangles, ACMR " << meshBefore.mACMR << " -> " << meshAfter.mACMR
+                << ", ATVR " << meshBefore.mATVR << " -> " << meshAfter.mATVR << std::endl;
+            before.mTransforms += meshBefore.mTransforms;
+            before.mTriangles += meshBefore.mTriangles;
+            after.mTransforms += meshAfter.mTransforms;
+        }
+    });
+    std::cout << "Optimized " << meshes.size() << " meshes: " << before.mTransforms << " -> " << after.mTransforms << " vertex transforms for "
+        << before.mTriangles << " triangles" << std::endl;
+}
+
+// Appends the simplified levels of every mesh to its index buffer, each from the previous one.
+void GenerateLods(Model* model, const ModelOptions& options) {
+    if (options.mLodLevels == 0) return;
+    std::unordered_set<Mesh*> meshes;
+    model->mRootNode->Recurse([&](ModelNode& node) {
+        for (auto& mesh : node.mMeshes) {
+            if (!meshes.insert(mesh.get()).second || mesh->mIndices.empty()) continue;
+            mesh->UpdateAABB();
+            const float diagonal = std::max(glm::length(mesh->mAABB.mHalfSize) * 2.0f, 1e-6f);
+            mesh->mLods = { { 0, (uint32_t)mesh->mIndices.size(), 0.0f } };
+            std::vector<uint32_t> level = mesh->mIndices;
+            // One write per line, models are imported on several threads at once
+            std::ostringstream log;
+            log << "LODs of " << node.mName << ": " << level.size() / 3;
+            for (uint32_t i = 0; i < options.mLodLevels; ++i) {
+                const size_t target = (size_t)(level.size() / 3 * options.mLodReduction) * 3;
+                float error = 0.0f;
+                auto simplified = SimplifyMesh(mesh->mVertices, level, target, options.mLodMaxError * diagonal, &error);
+                // Stop once the error limit keeps a level from getting meaningfully smaller
+                if (simplified.empty() || simplified.size() * 10 > level.size() * 9) break;
+                if (options.mOptimizeMeshes) OptimizeVertexCache(simplified, mesh->mVertices.size());
+                const float lodError = mesh->mLods.back().mError + error / diagonal;
+                mesh->mLods.push_back({ (uint32_t)mesh->mIndices.size(), (uint32_t)simplified.size(), lodError });
+                mesh->mIndices.insert(mesh->mIndices.end(), simplified.begin(), simplified.end());
+                log << ", " << simplified.size() / 3;
+                level = std::move(simplified);
+            }
+            log << " triangles\n";
+            std::cout << log.str() << std::flush;
+            if (mesh->mLods.size() == 1) mesh->mLods.clear();
+        }
+    });
+}
+
 const aiScene* LoadScene(const std::string& fileName, const ModelOptions& options) {
     auto props = aiCreatePropertyStore();
     if(1.0f != options.mScale) aiSetImportPropertyFloat(props, AI_CONFIG_GLOBAL_SCALE_FACTOR_KEY, options.mScale);
@@ -178,23 +280,117 @@ const aiScene* LoadScene(const std::string& fileName, const ModelOptions& option
     return scene;
 }
 
+void PrintLoadTime(const std::string& fileName, const bool cached, const std::chrono::high_resolution_clock::time_point start) {
+    const auto end = std::chrono::high_resolution_clock::now();
+    std::cout << (cached ? "Loaded " : "Imported ") << fileName << (cached ? " from cache" : "") << " in "
+        << std::chrono::duration<double, std::milli>(end - start).count() << " ms" << std::endl;
+}
+
 void Model::Load(const std::string& fileName, const ModelOptions& options) {
-    const auto scene = LoadScene(fileName, options);
+    const auto start = std::chrono::high_resolution_clock::now();
+    const bool cached = Import(fileName, options);
+    PrintLoadTime(fileName, cached, start);
+    PrintMeshStats();
+}
+
+bool Model::Import(const std::string& fileName, const ModelOptions& options) {
     mName = fileName;
     mRootNode.reset();
     mAnimationSet.reset();
-    mGlobalInverseTransform = FindGlobalInverseTransform(scene);
-    LoadAnimations(this, scene);
-    mRootNode = LoadNode(this, scene, scene->mRootNode);
-    if(!options.mAnimations && mAnimationSet) mAnimationSet->mAnimations.clear(); // FIXME!
-    aiReleaseImport(scene);
+    const bool cached = options.mCache && ReadModelCache(*this, fileName, options);
+    if (!cached) {
+        const auto scene = LoadScene(fileName, options);
+        mGlobalInverseTransform = FindGlobalInverseTransform(scene);
+        LoadAnimations(this, scene);
+        std::vector<Mesh_> meshes(scene->mNumMeshes);
+        mRootNode = LoadNode(this, scene, scene->mRootNode, meshes);
+        aiReleaseImport(scene);
+        OptimizeMeshes(this, options);
+        GenerateLods(this, options);
+        if (options.mPackVertices) {
+            mRootNode->Recurse([](ModelNode& node) {
+                for (auto& mesh : node.mMeshes) {
+                    if (!mesh->IsPacked()) mesh->Pack();
+                }
+            });
+        }
+        if (options.mCache) WriteModelCache(*this, fileName, options);
+    }
+    if(!options.mAnimations && mAnimationSet) mAnimationSet->ClearAnimations(); // FIXME!
+    if(mAnimationSet) ReduceAnimations(this, 0, options);
+    if(mAnimationSet) mAnimationSet->Bind();
+    if(mAnimationSet && options.mCompressAnimations) CompressAnimations(this);
     UpdateAABB();
+    return cached;
+}
+
+Model::MeshStats Model::GetMeshStats() const {
+    MeshStats stats;
+    std::unordered_set<const Mesh*> meshes;
+    if (mRootNode) {
+        mRootNode->Recurse([&stats, &meshes](ModelNode& node) {
+            for (const auto& mesh : node.mMeshes) {
+                stats.mInstances++;
+                if (!meshes.insert(mesh.get()).second) {
+                    stats.mSharedBytes += mesh->GetVertexBufferSize() + mesh->GetIndexBufferSize();
+                    continue;
+                }
+                const size_t numVertices = mesh->GetVertices().size();
+                const size_t numIndices = mesh->GetIndices().size();
+                stats.mMeshes++;
+                stats.mVertices += numVertices;
+                stats.mBytes += numVertices * sizeof(Vertex);
+                stats.mPackedBytes += mesh->GetVertexBufferSize();
+                stats.mIndices += numIndices;
+                stats.mIndexBytes += numIndices * sizeof(uint32_t);
+                stats.mShortIndexBytes += mesh->GetIndexBufferSize();
+            }
+        });
+    }
+    return stats;
+}
+
+void Model::PrintMeshStats() const {
+    const auto stats = GetMeshStats();
+    std::cout << mName << ": " << stats.mMeshes << " meshes in " << stats.mInstances << " nodes, vertices "
+        << stats.mBytes << " -> " << stats.mPackedBytes << " bytes, indices " << stats.mIndexBytes << " -> " << stats.mShortIndexBytes
+        << " bytes, " << stats.mSharedBytes << " bytes saved by sharing" << std::endl;
 }
 
 void Model::LoadAnimation(const std::string& fileName, const ModelOptions& options, bool append) {
-    const auto scene = LoadScene(fileName, options);
+    const auto start = std::chrono::high_resolution_clock::now();
     if (!append) {
         mAnimationSet.reset();
     }
-    LoadAnimations(this, scene);
+    Model source;
+    const bool cached = source.ImportAnimation(fileName, options);
+    AddAnimations(source, options);
+    PrintLoadTime(fileName, cached, start);
+}
+
+bool Model::ImportAnimation(const std::string& fileName, const ModelOptions& options) {
+    mName = fileName;
+    mAnimationSet.reset();
+    const bool cached = options.mCache && ReadAnimationCache(*this, fileName, options);
+    if (!cached) {
+        const auto scene = LoadScene(fileName, options);
+        LoadAnimations(this, scene);
+        aiReleaseImport(scene);
+        if (options.mCache) WriteAnimationCache(*this, fileName, options);
+    }
+    return cached;
+}
+
+void Model::AddAnimations(const Model& source, const ModelOptions& options) {
+    if (!mAnimationSet) {
+        mAnimationSet = std::make_shared<AnimationSet>();
+        mAnimationSet->mRootNode = source.mAnimationSet->mRootNode;
+    }
+    const size_t firstAnimation = mAnimationSet->mAnimations.size();
+    for (const auto& animation : source.mAnimationSet->mAnimations) {
+        mAnimationSet->AddAnimation(animation);
+    }
+    ReduceAnimations(this, firstAnimation, options);
+    mAnimationSet->Bind();
+    if (options.mCompressAnimations) CompressAnimations(this);
 }
@@ -1,6 +1,6 @@
 #pragma once
 
-#include "Main.h"
+#include "Core.h"
 #include "Mesh.h"
 #include "Animation.h"
 #include "AABB.h"
@@ -28,6 +28,17 @@ typedef ModelNode::ModelNode_ ModelNode_;
 struct ModelOptions {
 	float mScale = 1.0f;
 	bool mAnimations = true;
+	bool mCompressAnimations = false;
+	bool mReduceKeyFrames = false;
+	float mKeyFrameDistanceTolerance = 0.001f; // Model space units
+	float mKeyFrameAngleTolerance = 0.001f; // Radians
+	bool mCache = true; // Load from and write to ModelCache.h files
+	bool mPackVertices = false; // Upload PackedVertex instead of Vertex
+	bool mOptimizeMeshes = true; // Reorder triangles and vertices for the GPU caches, see MeshOptimizer.h
+	bool mOptimizeOverdraw = false; // Also order triangles to reduce overdraw, costs some vertex cache hits
+	uint32_t mLodLevels = 0; // Simplified levels generated per mesh, see MeshSimplifier.h
+	float mLodReduction = 0.5f; // Triangles of each level relative to the previous one
+	float mLodMaxError = 0.05f; // Relative to the mesh AABB diagonal
 };
 
 struct Model {
@@ -36,12 +47,20 @@ struct Model {
 	AnimationSet_ mAnimationSet;
 	glm::mat4 mGlobalInverseTransform;
 	AABB mAABB;
+	bool mStreaming = false; // Meshes are still being uploaded by MeshUploader, don't render
 	void Load(const std::string& fileName) { Load(fileName, {}); }
 	void Load(const std::string& fileName, const ModelOptions& options);
 	void LoadAnimation(const std::string& fileName, bool append = false) {
 		LoadAnimation(fileName, {}, append);
 	}
 	void LoadAnimation(const std::string& fileName, const ModelOptions& options, bool append = false);
+	// Load without reporting, returns true when the model came from its cache file. Only touches
+	// this model and leaves GL buffers to Mesh::Bind, so different models can import concurrently.
+	bool Import(const std::string& fileName, const ModelOptions& options);
+	// Replaces the animation set with the unprocessed clips of fileName, see AddAnimations.
+	bool ImportAnimation(const std::string& fileName, const ModelOptions& options);
+	// Appends the clips of a model loaded with ImportAnimation, then reduces, binds and compresses them.
+	void AddAnimations(const Model& source, const ModelOptions& options);
 	void UpdateAABB() {
 		AABB aabb;
 		glm::mat4 transform = glm::identity<glm::mat4>();
@@ -53,6 +72,21 @@ struct Model {
 		});
 		mAABB = aabb;
 	}
+	// Vertex and index counts and GPU buffer sizes of every mesh. Vertex sizes are as Vertex
+	// and as uploaded (PackedVertex), index sizes as 32-bit and as uploaded (16-bit if possible).
+	struct MeshStats {
+		size_t mMeshes = 0;
+		size_t mInstances = 0; // Node references, shared meshes count once per node
+		size_t mVertices = 0;
+		size_t mBytes = 0;
+		size_t mPackedBytes = 0;
+		size_t mIndices = 0;
+		size_t mIndexBytes = 0;
+		size_t mShortIndexBytes = 0;
+		size_t mSharedBytes = 0; // Uploaded bytes saved by sharing meshes between nodes
+	};
+	MeshStats GetMeshStats() const;
+	void PrintMeshStats() const;
 	bool HasAnimations() const {
 		// FIXME
 		return nullptr != mAnimationSet && mAnimationSet->mAnimations.size() > 0;
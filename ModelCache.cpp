@@ -0,0 +1,438 @@
+#include "ModelCache.h"
+
+#include <filesystem>
+#include <thread>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+const char gModelCacheMagic[8] = { 'A', 'N', 'I', 'M', 'C', 'A', 'C', 'H' };
+
+bool MappedFile::Open(const std::string& fileName) {
+	Close();
+#ifdef _WIN32
+	mFile = CreateFileA(fileName.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (mFile == INVALID_HANDLE_VALUE) {
+		mFile = nullptr;
+		return false;
+	}
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(mFile, &size) || size.QuadPart == 0) {
+		Close();
+		return false;
+	}
+	mMapping = CreateFileMappingA(mFile, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (mMapping) {
+		mData = static_cast<const uint8_t*>(MapViewOfFile(mMapping, FILE_MAP_READ, 0, 0, 0));
+	}
+	mSize = (size_t)size.QuadPart;
+#else
+	mFile = open(fileName.c_str(), O_RDONLY);
+	if (mFile < 0) return false;
+	struct stat info;
+	if (fstat(mFile, &info) != 0 || info.st_size == 0) {
+		Close();
+		return false;
+	}
+	void* data = mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, mFile, 0);
+	mData = data != MAP_FAILED ? static_cast<const uint8_t*>(data) : nullptr;
+	mSize = (size_t)info.st_size;
+#endif
+	if (!mData) {
+		Close();
+		return false;
+	}
+	return true;
+}
+
+void MappedFile::Close() {
+#ifdef _WIN32
+	if (mData) UnmapViewOfFile(mData);
+	if (mMapping) CloseHandle(mMapping);
+	if (mFile) CloseHandle(mFile);
+	mMapping = nullptr;
+	mFile = nullptr;
+#else
+	if (mData) munmap(const_cast<uint8_t*>(mData), mSize);
+	if (mFile >= 0) close(mFile);
+	mFile = -1;
+#endif
+	mData = nullptr;
+	mSize = 0;
+}
+
+struct CacheWriter {
+	std::vector<uint8_t> mData;
+
+	void Write(const void* data, const size_t size) {
+		const auto bytes = static_cast<const uint8_t*>(data);
+		mData.insert(mData.end(), bytes, bytes + size);
+	}
+
+	template<typename T>
+	void Write(const T& value) {
+		Write(&value, sizeof(T));
+	}
+
+	void WriteString(const std::string& value) {
+		Write((uint32_t)value.size());
+		Write(value.data(), value.size());
+	}
+
+	// Count first, then the aligned elements
+	template<typename T>
+	void WriteArray(const T* data, const size_t count) {
+		Write((uint32_t)count);
+		mData.resize((mData.size() + MODEL_CACHE_ALIGNMENT - 1) / MODEL_CACHE_ALIGNMENT * MODEL_CACHE_ALIGNMENT, 0);
+		Write(data, count * sizeof(T));
+	}
+};
+
+// Reads from the mapped file, sets mFailed instead of reading past the end.
+struct CacheReader {
+	const uint8_t* mData = nullptr;
+	size_t mSize = 0;
+	size_t mPosition = 0;
+	bool mFailed = false;
+
+	const void* Read(const size_t size) {
+		if (mFailed || size > mSize - mPosition) {
+			mFailed = true;
+			return nullptr;
+		}
+		const auto data = mData + mPosition;
+		mPosition += size;
+		return data;
+	}
+
+	template<typename T>
+	T Read() {
+		T value = {};
+		if (const auto data = Read(sizeof(T))) memcpy(&value, data, sizeof(T));
+		return value;
+	}
+
+	std::string ReadString() {
+		const auto size = Read<uint32_t>();
+		const auto data = Read(size);
+		return data ? std::string(static_cast<const char*>(data), size) : std::string();
+	}
+
+	template<typename T>
+	Span<const T> ReadArray() {
+		const auto count = Read<uint32_t>();
+		mPosition = std::min(mSize, (mPosition + MODEL_CACHE_ALIGNMENT - 1) / MODEL_CACHE_ALIGNMENT * MODEL_CACHE_ALIGNMENT);
+		const auto data = Read(count * sizeof(T));
+		return data ? Span<const T>(static_cast<const T*>(data), count) : Span<const T>();
+	}
+};
+
+uint64_t HashModelOptions(const ModelOptions& options, const uint64_t hash) {
+	const uint8_t flags[] = { options.mAnimations, options.mCompressAnimations, options.mReduceKeyFrames, options.mPackVertices,
+		options.mOptimizeMeshes, options.mOptimizeOverdraw };
+	const uint32_t counts[] = { options.mLodLevels };
+	const float values[] = { options.mScale, options.mKeyFrameDistanceTolerance, options.mKeyFrameAngleTolerance,
+		options.mLodReduction, options.mLodMaxError };
+	return HashBytes(values, sizeof(values), HashBytes(counts, sizeof(counts), HashBytes(flags, sizeof(flags), hash)));
+}
+
+uint64_t GetModelCacheKey(const std::string& fileName, const ModelOptions& options) {
+	std::error_code error;
+	const auto modified = std::filesystem::last_write_time(fileName, error);
+	if (error) return 0;
+	const int64_t time = modified.time_since_epoch().count();
+	uint64_t hash = HashBytes(fileName.data(), fileName.size());
+	hash = HashBytes(&time, sizeof(time), hash);
+	return HashModelOptions(options, hash);
+}
+
+// The modification time isn't part of the name, so a changed source overwrites its old cache.
+std::string GetModelCachePath(const std::string& fileName, const ModelOptions& options) {
+	char name[32];
+	snprintf(name, sizeof(name), ".%016llx.cache", (unsigned long long)HashModelOptions(options));
+	return fileName + name;
+}
+
+// Nodes are stored parents first, each with the index of its parent.
+template<typename TNode, typename TCallback>
+void WriteNodes(CacheWriter& writer, const std::shared_ptr<TNode>& root, TCallback callback) {
+	std::vector<std::pair<const TNode*, int32_t>> nodes;
+	if (root) nodes.push_back({ root.get(), -1 });
+	for (size_t i = 0; i < nodes.size(); ++i) {
+		for (const auto& child : nodes[i].first->mChildren) {
+			nodes.push_back({ child.get(), (int32_t)i });
+		}
+	}
+	writer.Write((uint32_t)nodes.size());
+	for (const auto& [node, parent] : nodes) {
+		writer.WriteString(node->mName);
+		writer.Write(parent);
+		writer.Write(node->mTransform);
+		callback(*node);
+	}
+}
+
+template<typename TNode, typename TCallback>
+std::shared_ptr<TNode> ReadNodes(CacheReader& reader, TCallback callback) {
+	const auto numNodes = reader.Read<uint32_t>();
+	std::vector<std::shared_ptr<TNode>> nodes;
+	for (uint32_t i = 0; i < numNodes && !reader.mFailed; ++i) {
+		const auto name = reader.ReadString();
+		const auto parentIndex = reader.Read<int32_t>();
+		const auto transform = reader.Read<glm::mat4>();
+		if (parentIndex >= (int32_t)nodes.size() || (parentIndex < 0 && i > 0)) {
+			reader.mFailed = true;
+			break;
+		}
+		const auto parent = parentIndex >= 0 ? nodes[parentIndex] : nullptr;
+		auto node = std::make_shared<TNode>(name, parent, transform);
+		if (parent) parent->mChildren.push_back(node);
+		callback(*node);
+		nodes.push_back(node);
+	}
+	return nodes.empty() ? nullptr : nodes[0];
+}
+
+template<typename T>
+void WriteKeyFrames(CacheWriter& writer, const KeyFrames<T>& keys) {
+	writer.WriteArray(keys.mTimes.data(), keys.mTimes.size());
+	writer.WriteArray(keys.mValues.data(), keys.mValues.size());
+}
+
+template<typename T>
+void ReadKeyFrames(CacheReader& reader, KeyFrames<T>& keys) {
+	const auto times = reader.ReadArray<float>();
+	const auto values = reader.ReadArray<T>();
+	if (times.size() != values.size()) reader.mFailed = true;
+	keys.mTimes.assign(times.begin(), times.end());
+	keys.mValues.assign(values.begin(), values.end());
+}
+
+void WriteAnimations(CacheWriter& writer, const AnimationSet& animationSet) {
+	writer.Write((uint32_t)animationSet.mAnimations.size());
+	for (const auto& animation : animationSet.mAnimations) {
+		writer.WriteString(animation->mName);
+		writer.Write(animation->mTicksPerSecond);
+		writer.Write(animation->mDuration);
+		writer.Write((uint32_t)animation->mAnimationTracks.size());
+		for (const auto& track : animation->mAnimationTracks) {
+			writer.WriteString(track->mName);
+			WriteKeyFrames(writer, track->mPositionKeys);
+			WriteKeyFrames(writer, track->mRotationKeys);
+			WriteKeyFrames(writer, track->mScalingKeys);
+		}
+	}
+}
+
+void ReadAnimations(CacheReader& reader, AnimationSet& animationSet) {
+	const auto numAnimations = reader.Read<uint32_t>();
+	for (uint32_t i = 0; i < numAnimations && !reader.mFailed; ++i) {
+		auto animation = std::make_shared<Animation>();
+		animation->mName = reader.ReadString();
+		animation->mTicksPerSecond = reader.Read<float>();
+		animation->mDuration = reader.Read<float>();
+		const auto numTracks = reader.Read<uint32_t>();
+		for (uint32_t t = 0; t < numTracks && !reader.mFailed; ++t) {
+			auto track = std::make_shared<AnimationTrack>();
+			track->mName = reader.ReadString();
+			ReadKeyFrames(reader, track->mPositionKeys);
+			ReadKeyFrames(reader, track->mRotationKeys);
+			ReadKeyFrames(reader, track->mScalingKeys);
+			animation->mAnimationTracks.push_back(track);
+		}
+		animationSet.AddAnimation(animation);
+	}
+}
+
+void WriteCacheFile(CacheWriter& writer, const ModelCacheType type, const std::string& fileName, const ModelOptions& options) {
+	auto& header = *reinterpret_cast<ModelCacheHeader*>(writer.mData.data());
+	memcpy(header.mMagic, gModelCacheMagic, sizeof(header.mMagic));
+	header.mVersion = MODEL_CACHE_VERSION;
+	header.mVertexSize = sizeof(Vertex);
+	header.mKey = GetModelCacheKey(fileName, options);
+	header.mPayloadSize = writer.mData.size() - sizeof(ModelCacheHeader);
+	header.mChecksum = HashBytes(writer.mData.data() + sizeof(ModelCacheHeader), header.mPayloadSize);
+	header.mType = type;
+	header.mReserved = 0;
+	if (!header.mKey) return;
+
+	// Written under a temporary name first so readers never see half a file. The name is
+	// unique per thread, models sharing a file may be imported at the same time.
+	const auto path = GetModelCachePath(fileName, options);
+	std::ostringstream temporaryName;
+	temporaryName << path << "." << std::this_thread::get_id() << ".tmp";
+	const auto temporaryPath = temporaryName.str();
+	{
+		std::ofstream stream(temporaryPath, std::ios::binary | std::ios::trunc);
+		if (!stream.is_open()) {
+			std::cerr << "Could not write model cache " << temporaryPath << std::endl;
+			return;
+		}
+		stream.write(reinterpret_cast<const char*>(writer.mData.data()), writer.mData.size());
+	}
+	std::error_code error;
+	std::filesystem::rename(temporaryPath, path, error);
+	if (error) {
+		std::cerr << "Could not write model cache " << path << ": " << error.message() << std::endl;
+		std::filesystem::remove(temporaryPath, error);
+	}
+}
+
+// Maps the cache file for fileName, null unless it is current and intact.
+MappedFile_ OpenCacheFile(CacheReader& reader, const ModelCacheType type, const std::string& fileName, const ModelOptions& options) {
+	auto file = std::make_shared<MappedFile>();
+	if (!file->Open(GetModelCachePath(fileName, options))) return nullptr;
+	if (file->mSize < sizeof(ModelCacheHeader)) return nullptr;
+	const auto& header = *reinterpret_cast<const ModelCacheHeader*>(file->mData);
+	if (memcmp(header.mMagic, gModelCacheMagic, sizeof(header.mMagic)) != 0
+		|| header.mVersion != MODEL_CACHE_VERSION
+		|| header.mVertexSize != sizeof(Vertex)
+		|| header.mType != type
+		|| header.mKey != GetModelCacheKey(fileName, options)
+		|| header.mPayloadSize != file->mSize - sizeof(ModelCacheHeader)) {
+		return nullptr;
+	}
+	if (header.mChecksum != HashBytes(file->mData + sizeof(ModelCacheHeader), header.mPayloadSize)) {
+		std::cerr << "Model cache for " << fileName << " is corrupt" << std::endl;
+		return nullptr;
+	}
+	reader.mData = file->mData;
+	reader.mSize = file->mSize;
+	reader.mPosition = sizeof(ModelCacheHeader);
+	return file;
+}
+
+void WriteModelCache(const Model& model, const std::string& fileName, const ModelOptions& options) {
+	CacheWriter writer;
+	writer.mData.resize(sizeof(ModelCacheHeader));
+	writer.Write(model.mGlobalInverseTransform);
+
+	// Meshes can be shared between nodes, nodes refer to them by index
+	std::vector<const Mesh*> meshes;
+	std::unordered_map<const Mesh*, uint32_t> meshIndices;
+	if (model.mRootNode) {
+		model.mRootNode->Recurse([&](ModelNode& node) {
+			for (const auto& mesh : node.mMeshes) {
+				if (meshIndices.emplace(mesh.get(), (uint32_t)meshes.size()).second) meshes.push_back(mesh.get());
+			}
+		});
+	}
+	writer.Write((uint32_t)meshes.size());
+	for (const auto mesh : meshes) {
+		writer.Write(mesh->mHidden);
+		writer.Write(mesh->mAABB);
+		const auto vertices = mesh->GetVertices();
+		const auto indices = mesh->GetIndices();
+		const auto packedVertices = mesh->GetPackedVertices();
+		writer.WriteArray(vertices.data(), vertices.size());
+		writer.WriteArray(indices.data(), indices.size());
+		writer.WriteArray(packedVertices.data(), packedVertices.size());
+		const auto lods = mesh->GetLods();
+		writer.WriteArray(lods.data(), lods.size());
+	}
+	WriteNodes(writer, model.mRootNode, [&](const ModelNode& node) {
+		writer.Write((uint32_t)node.mMeshes.size());
+		for (const auto& mesh : node.mMeshes) writer.Write(meshIndices[mesh.get()]);
+	});
+
+	const auto& animationSet = model.mAnimationSet;
+	writer.Write((uint8_t)(animationSet ? 1 : 0));
+	if (animationSet) {
+		WriteNodes(writer, animationSet->mRootNode, [](const AnimationNode&) {});
+		std::vector<std::string> boneNames(animationSet->mBoneMappings.size());
+		for (const auto& [name, boneIndex] : animationSet->mBoneMappings) boneNames[boneIndex] = name;
+		writer.Write((uint32_t)boneNames.size());
+		for (size_t i = 0; i < boneNames.size(); ++i) {
+			writer.WriteString(boneNames[i]);
+			writer.Write(animationSet->mBoneOffsets[i]);
+		}
+		WriteAnimations(writer, *animationSet);
+	}
+	WriteCacheFile(writer, ModelCacheType::Model, fileName, options);
+}
+
+bool ReadModelCache(Model& model, const std::string& fileName, const ModelOptions& options) {
+	CacheReader reader;
+	const auto file = OpenCacheFile(reader, ModelCacheType::Model, fileName, options);
+	if (!file) return false;
+
+	const auto globalInverseTransform = reader.Read<glm::mat4>();
+	std::vector<Mesh_> meshes(reader.Read<uint32_t>());
+	for (auto& mesh : meshes) {
+		if (reader.mFailed) return false;
+		mesh = std::make_shared<Mesh>();
+		mesh->mHidden = reader.Read<bool>();
+		mesh->mAABB = reader.Read<AABB>();
+		mesh->mMappedVertices = reader.ReadArray<Vertex>();
+		mesh->mMappedIndices = reader.ReadArray<uint32_t>();
+		mesh->mMappedPackedVertices = reader.ReadArray<PackedVertex>();
+		mesh->mMappedLods = reader.ReadArray<MeshLod>();
+		mesh->mMapping = file;
+	}
+	const auto rootNode = ReadNodes<ModelNode>(reader, [&](ModelNode& node) {
+		const auto numMeshes = reader.Read<uint32_t>();
+		for (uint32_t i = 0; i < numMeshes && !reader.mFailed; ++i) {
+			const auto meshIndex = reader.Read<uint32_t>();
+			if (meshIndex < meshes.size()) {
+				node.mMeshes.push_back(meshes[meshIndex]);
+			} else {
+				reader.mFailed = true;
+			}
+		}
+	});
+
+	AnimationSet_ animationSet;
+	if (reader.Read<uint8_t>()) {
+		animationSet = std::make_shared<AnimationSet>();
+		animationSet->mRootNode = ReadNodes<AnimationNode>(reader, [](AnimationNode&) {});
+		const auto numBones = reader.Read<uint32_t>();
+		for (uint32_t i = 0; i < numBones && !reader.mFailed; ++i) {
+			const auto name = reader.ReadString();
+			animationSet->MapBone(name, reader.Read<glm::mat4>());
+		}
+		ReadAnimations(reader, *animationSet);
+	}
+	if (reader.mFailed) return false;
+
+	model.mGlobalInverseTransform = globalInverseTransform;
+	model.mRootNode = rootNode;
+	model.mAnimationSet = animationSet;
+	return true;
+}
+
+void WriteAnimationCache(const Model& model, const std::string& fileName, const ModelOptions& options) {
+	CacheWriter writer;
+	writer.mData.resize(sizeof(ModelCacheHeader));
+	WriteNodes(writer, model.mAnimationSet->mRootNode, [](const AnimationNode&) {});
+	WriteAnimations(writer, *model.mAnimationSet);
+	WriteCacheFile(writer, ModelCacheType::Animation, fileName, options);
+}
+
+bool ReadAnimationCache(Model& model, const std::string& fileName, const ModelOptions& options) {
+	CacheReader reader;
+	const auto file = OpenCacheFile(reader, ModelCacheType::Animation, fileName, options);
+	if (!file) return false;
+
+	// Parsed into a separate set first, so a damaged file leaves the model untouched
+	AnimationSet animations;
+	animations.mRootNode = ReadNodes<AnimationNode>(reader, [](AnimationNode&) {});
+	ReadAnimations(reader, animations);
+	if (reader.mFailed) return false;
+
+	if (!model.mAnimationSet) {
+		model.mAnimationSet = std::make_shared<AnimationSet>();
+		model.mAnimationSet->mRootNode = animations.mRootNode;
+	}
+	for (const auto& animation : animations.mAnimations) {
+		model.mAnimationSet->AddAnimation(animation);
+	}
+	return true;
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include "Model.h"
+
+// Cooked copies of imported model and animation files, written next to the source file on
+// first import and memory mapped afterwards. Vertex and index data of cached meshes is used
+// in place (Mesh::mMapping), the hierarchy, bones and clips are copied out.
+//
+// Layout: ModelCacheHeader followed by the payload, arrays aligned to MODEL_CACHE_ALIGNMENT.
+// The cache holds what assimp produced, keyframe reduction and compression run after loading.
+// Bump MODEL_CACHE_VERSION whenever the payload or any type stored in it changes.
+
+#define MODEL_CACHE_VERSION 4
+#define MODEL_CACHE_ALIGNMENT 16
+#define MODEL_CACHE_HASH_SEED 14695981039346656037ull // FNV-1a offset basis
+
+enum class ModelCacheType : uint32_t {
+	Model = 1,
+	Animation = 2,
+};
+
+struct ModelCacheHeader {
+	char mMagic[8];
+	uint32_t mVersion;
+	uint32_t mVertexSize; // sizeof(Vertex) when written
+	uint64_t mKey; // GetModelCacheKey
+	uint64_t mChecksum; // Of the payload
+	uint64_t mPayloadSize;
+	ModelCacheType mType;
+	uint32_t mReserved;
+};
+
+// Read only view of a whole file.
+struct MappedFile {
+	const uint8_t* mData = nullptr;
+	size_t mSize = 0;
+#ifdef _WIN32
+	void* mFile = nullptr;
+	void* mMapping = nullptr;
+#else
+	int mFile = -1;
+#endif
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+	MappedFile() {}
+	~MappedFile() {
+		Close();
+	}
+	bool Open(const std::string& fileName);
+	void Close();
+};
+typedef std::shared_ptr<MappedFile> MappedFile_;
+
+inline uint64_t HashBytes(const void* data, const size_t size, uint64_t hash = MODEL_CACHE_HASH_SEED) {
+	const auto bytes = static_cast<const uint8_t*>(data);
+	for (size_t i = 0; i < size; ++i) {
+		hash = (hash ^ bytes[i]) * 1099511628211ull;
+	}
+	return hash;
+}
+
+// Every option is included, even those applied after loading from the cache.
+uint64_t HashModelOptions(const ModelOptions& options, uint64_t hash = MODEL_CACHE_HASH_SEED);
+
+// Source path, modification time and options. 0 if the source file doesn't exist.
+uint64_t GetModelCacheKey(const std::string& fileName, const ModelOptions& options);
+
+std::string GetModelCachePath(const std::string& fileName, const ModelOptions& options);
+
+// Replaces the contents of model with the cached import of fileName, false on a cache miss.
+bool ReadModelCache(Model& model, const std::string& fileName, const ModelOptions& options);
+void WriteModelCache(const Model& model, const std::string& fileName, const ModelOptions& options);
+
+// Appends the cached clips of fileName to the animation set of model, creating it from the
+// cached hierarchy if there is none. False on a cache miss.
+bool ReadAnimationCache(Model& model, const std::string& fileName, const ModelOptions& options);
+// Writes the hierarchy and every clip of the animation set of model.
+void WriteAnimationCache(const Model& model, const std::string& fileName, const ModelOptions& options);
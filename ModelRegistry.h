@@ -0,0 +1,37 @@
+#pragma once
+
+#include "Model.h"
+#include "ModelCache.h"
+
+// Keys every combination of model file, options and animation files, so Scene imports each
+// once and hands out the same Model (and so the same meshes, GPU buffers and AnimationSet)
+// to every entity asking for it. Entries don't keep models alive, a model is freed with its
+// last user.
+struct ModelRegistry {
+	std::unordered_map<std::string, std::weak_ptr<Model>> mModels;
+
+	static std::string GetKey(const std::string& fileName, const ModelOptions& options, const std::vector<std::string>& animations) {
+		std::string key = fileName + '\n' + std::to_string(HashModelOptions(options));
+		for (const auto& animation : animations) {
+			key += '\n' + animation;
+		}
+		return key;
+	}
+
+	Model_ Find(const std::string& key) const {
+		const auto it = mModels.find(key);
+		return it != mModels.end() ? it->second.lock() : nullptr;
+	}
+
+	void Add(const std::string& key, Model_ model) {
+		mModels[key] = model;
+	}
+
+	size_t GetLoadedCount() const {
+		size_t count = 0;
+		for (const auto& [key, model] : mModels) {
+			if (!model.expired()) count++;
+		}
+		return count;
+	}
+};
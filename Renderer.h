@@ -0,0 +1,205 @@
+#pragma once
+
+#include "GeometryBuffer.h"
+#include "StreamBuffer.h"
+#include "Model.h"
+
+// Draws the scene from GeometryBuffer with one glMultiDrawElementsIndirect per pool. Every
+// mesh instance becomes a DrawData entry in a shader storage buffer, read through the per
+// instance draw index attribute, which starts at the command's baseInstance. gl_DrawID would
+// need GL 4.6, baseInstance works from 4.2 and survives the fallback path that issues one
+// glDrawElementsInstancedBaseVertexBaseInstance per command.
+// With instancing, entries of the same mesh and LOD are made contiguous and share a command,
+// the draw index then steps through them like gl_InstanceID would.
+// Bone palettes of all entities are concatenated into a second storage buffer. Both storage
+// buffers and the commands are written with one memcpy each into a StreamBuffer region.
+
+#define DRAW_FLAG_PACKED 1
+#define DRAW_FLAG_SKINNED 2
+#define DRAW_FLAG_DUAL_QUATERNION 4 // Bones are DualQuat instead of Affine
+
+#define DRAW_DATA_BINDING 0
+#define BONE_BUFFER_BINDING 1
+
+// std430 layout of DrawData in default.vert.glsl
+struct DrawData {
+	Affine mModel; // A mat3x4 in the shader
+	glm::vec4 mPositionOffset; // xyz, see Mesh::GetPositionOffset
+	glm::vec4 mPositionScale;
+	uint32_t mBoneOffset = 0; // First vec4 of the entity's palette in the bone buffer
+	uint32_t mFlags = 0; // DRAW_FLAG_*
+	uint32_t mPadding[2] = { 0, 0 };
+};
+
+// Layout of DrawElementsIndirectCommand
+struct DrawCommand {
+	uint32_t mCount;
+	uint32_t mInstanceCount;
+	uint32_t mFirstIndex;
+	int32_t mBaseVertex;
+	uint32_t mBaseInstance;
+};
+
+struct Renderer {
+	struct Instance {
+		const Mesh* mMesh;
+		size_t mLevel;
+		DrawData mData;
+	};
+	GeometryBuffer mGeometry;
+	std::vector<Instance> mInstances; // In Add order
+	std::vector<DrawData> mDraws; // In command order
+	std::vector<DrawCommand> mCommands[GEOMETRY_POOLS];
+	std::vector<glm::vec4> mBones; // Palettes of Affine (3 vec4) or DualQuat (2 vec4) bones
+	StreamBuffer mDrawBuffer = StreamBuffer(GL_SHADER_STORAGE_BUFFER);
+	StreamBuffer mBoneBuffer = StreamBuffer(GL_SHADER_STORAGE_BUFFER);
+	StreamBuffer mCommandBuffer = StreamBuffer(GL_DRAW_INDIRECT_BUFFER);
+	std::vector<DrawCommand> mCommandData; // All pools, uploaded in one piece
+	const Camera* mCamera = nullptr;
+	float mViewportHeight = 0.0f; // Pixels
+	bool mLods = true;
+	bool mMultiDraw = true; // Otherwise one draw call per command
+	bool mInstancing = true; // Otherwise one command per mesh instance
+	size_t mTriangles = 0; // Drawn by the last Render
+	size_t mDrawCalls = 0;
+
+	Renderer() {}
+	Renderer(const Renderer&) = delete;
+	Renderer& operator=(const Renderer&) = delete;
+
+	void Begin(const Camera& camera, const float viewportHeight) {
+		mCamera = &camera;
+		mViewportHeight = viewportHeight;
+		mInstances.clear();
+		mBones.clear();
+	}
+
+	// Queues every visible mesh of the model, controller may be null for unskinned entities.
+	void Add(const Model& model, const Affine& transform, const AnimationController* controller) {
+		static_assert(sizeof(Affine) == 3 * sizeof(glm::vec4) && sizeof(DualQuat) == 2 * sizeof(glm::vec4), "Bones must be whole vec4s");
+		const uint32_t boneOffset = (uint32_t)mBones.size();
+		uint32_t flags = 0;
+		if (controller && controller->mSkinning == SkinningMode::DualQuaternion) {
+			const auto bones = (const glm::vec4*)controller->mDualQuaternions.data();
+			mBones.insert(mBones.end(), bones, bones + controller->mDualQuaternions.size() * 2);
+			flags = DRAW_FLAG_SKINNED | DRAW_FLAG_DUAL_QUATERNION;
+		} else if (controller) {
+			const auto bones = (const glm::vec4*)controller->mFinalTransforms.data();
+			mBones.insert(mBones.end(), bones, bones + controller->mFinalTransforms.size() * 3);
+			flags = DRAW_FLAG_SKINNED;
+		}
+		AddNode(*model.mRootNode, transform, boneOffset, flags);
+	}
+
+	void Render() {
+		mTriangles = 0;
+		mDrawCalls = 0;
+		if (mInstances.empty()) return;
+		BuildCommands();
+		mGeometry.ReserveDraws(mDraws.size());
+		UploadStorage(mDrawBuffer, DRAW_DATA_BINDING, mDraws.data(), mDraws.size() * sizeof(DrawData));
+		UploadStorage(mBoneBuffer, BONE_BUFFER_BINDING, mBones.data(), mBones.size() * sizeof(glm::vec4));
+
+		size_t offset = 0; // Bytes into mCommandBuffer
+		if (mMultiDraw) {
+			mCommandData.clear();
+			for (const auto& commands : mCommands) mCommandData.insert(mCommandData.end(), commands.begin(), commands.end());
+			const size_t bytes = mCommandData.size() * sizeof(DrawCommand);
+			std::memcpy(mCommandBuffer.Begin(bytes), mCommandData.data(), bytes);
+			glBindBuffer(GL_DRAW_INDIRECT_BUFFER, mCommandBuffer.mBuffer);
+			offset = mCommandBuffer.GetOffset();
+		}
+
+		for (int poolIndex = 0; poolIndex < GEOMETRY_POOLS; ++poolIndex) {
+			const auto& commands = mCommands[poolIndex];
+			if (commands.empty()) continue;
+			const auto& pool = mGeometry.mPools[poolIndex];
+			mGeometry.Bind(pool);
+			if (mMultiDraw) {
+				glMultiDrawElementsIndirect(GL_TRIANGLES, pool.GetIndexType(), (GLvoid*)offset, (GLsizei)commands.size(), 0);
+				mDrawCalls++;
+			} else {
+				for (const auto& command : commands) {
+					glDrawElementsInstancedBaseVertexBaseInstance(GL_TRIANGLES, command.mCount, pool.GetIndexType(), (GLvoid*)(command.mFirstIndex * pool.GetIndexSize()),
+						command.mInstanceCount, command.mBaseVertex, command.mBaseInstance);
+				}
+				mDrawCalls += commands.size();
+			}
+			for (const auto& command : commands) mTriangles += command.mCount / 3 * command.mInstanceCount;
+			offset += commands.size() * sizeof(DrawCommand);
+		}
+		glBindVertexArray(0);
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+		mDrawBuffer.End();
+		mBoneBuffer.End();
+		if (mMultiDraw) mCommandBuffer.End();
+	}
+
+protected:
+	void AddNode(const ModelNode& node, const Affine& parentTransform, const uint32_t boneOffset, const uint32_t flags) {
+		const Affine transform = parentTransform * Affine::FromMat4(node.mTransform);
+		const float scale = transform.GetMaxScale();
+		for (const auto& mesh : node.mMeshes) {
+			if (mesh->mHidden || mesh->GetIndices().empty()) continue;
+			// Models loaded without MeshUploader are uploaded the first time they are drawn
+			if (mesh->mGeometryPool < 0) mGeometry.Upload(*mesh);
+			size_t level = 0;
+			if (mLods && mesh->GetLodCount() > 1) {
+				const auto center = transform.TransformPoint(mesh->mAABB.mCenter);
+				const float radius = glm::length(mesh->mAABB.mHalfSize) * scale;
+				level = mesh->SelectLod(mCamera->GetScreenSize(center, radius) * mViewportHeight);
+			}
+
+			Instance instance;
+			instance.mMesh = mesh.get();
+			instance.mLevel = level;
+			instance.mData.mModel = transform;
+			instance.mData.mPositionOffset = glm::vec4(mesh->GetPositionOffset(), 0.0f);
+			instance.mData.mPositionScale = glm::vec4(mesh->GetPositionScale(), 0.0f);
+			instance.mData.mBoneOffset = boneOffset;
+			instance.mData.mFlags = (mesh->IsPacked() ? DRAW_FLAG_PACKED : 0) | flags;
+			mInstances.push_back(instance);
+		}
+		for (const auto& child : node.mChildren) {
+			AddNode(*child, transform, boneOffset, flags);
+		}
+	}
+
+	// Orders the instances by pool, so each pool's commands are contiguous for its multi-draw,
+	// and with instancing by mesh and LOD so every mesh and LOD becomes a single command.
+	void BuildCommands() {
+		const bool instancing = mInstancing;
+		std::stable_sort(mInstances.begin(), mInstances.end(), [instancing](const Instance& a, const Instance& b) {
+			if (a.mMesh->mGeometryPool != b.mMesh->mGeometryPool) return a.mMesh->mGeometryPool < b.mMesh->mGeometryPool;
+			if (!instancing) return false;
+			return a.mMesh != b.mMesh ? std::less<const Mesh*>()(a.mMesh, b.mMesh) : a.mLevel < b.mLevel;
+		});
+		mDraws.clear();
+		for (auto& commands : mCommands) commands.clear();
+		const Instance* previous = nullptr;
+		for (const auto& instance : mInstances) {
+			auto& commands = mCommands[instance.mMesh->mGeometryPool];
+			if (instancing && previous && previous->mMesh == instance.mMesh && previous->mLevel == instance.mLevel) {
+				commands.back().mInstanceCount++;
+			} else {
+				const auto lod = instance.mMesh->GetLod(instance.mLevel);
+				DrawCommand command;
+				command.mCount = lod.mNumIndices;
+				command.mInstanceCount = 1;
+				command.mFirstIndex = instance.mMesh->mBaseIndex + lod.mFirstIndex;
+				command.mBaseVertex = (int32_t)instance.mMesh->mBaseVertex;
+				command.mBaseInstance = (uint32_t)mDraws.size();
+				commands.push_back(command);
+			}
+			mDraws.push_back(instance.mData);
+			previous = &instance;
+		}
+	}
+
+	// Binds this frame's region, which is never empty so the binding is always valid.
+	static void UploadStorage(StreamBuffer& buffer, const GLuint binding, const void* data, const size_t bytes) {
+		auto region = buffer.Begin(std::max<size_t>(bytes, sizeof(Affine)));
+		if (bytes > 0) std::memcpy(region, data, bytes);
+		glBindBufferRange(GL_SHADER_STORAGE_BUFFER, binding, buffer.mBuffer, buffer.GetOffset(), buffer.mRegionSize);
+	}
+};
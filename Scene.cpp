@@ -1,16 +1,42 @@
 #include "Scene.h"
 
-void Scene::Load(const std::string& fileName) {
+#include <chrono>
+#include <exception>
+
+// One file of a ModelImport, mAnimation is -1 for the model itself.
+struct FileImport {
+	size_t mImport;
+	int mAnimation;
+	Model_ mModel;
+	bool mCached = false;
+	double mTime = 0.0;
+	std::exception_ptr mError;
+};
+
+double GetMilliseconds(const std::chrono::high_resolution_clock::time_point start) {
+	return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+void Scene::Parse(const std::string& fileName, std::vector<ModelImport>& imports, std::vector<PendingEntity>& entities) {
 	rapidjson::Document config;
 	std::ifstream ifs(fileName);
 	assert(ifs.is_open());
 	rapidjson::IStreamWrapper isw(ifs);
 	config.ParseStream(isw);
 
+	if (config.HasMember("threads")) {
+		mNumThreads = config["threads"].GetUint();
+	}
+	if (config.HasMember("streaming")) {
+		mStreamingEnabled = config["streaming"].GetBool();
+	}
+	if (config.HasMember("uploadBudget")) {
+		mUploadBudget = config["uploadBudget"].GetUint();
+	}
+
+	std::unordered_map<std::string, size_t> importIndices;
 	for (const auto& cfg : config["entities"].GetArray()) {
 		if (cfg.HasMember("disabled") && cfg["disabled"].GetBool()) continue;
-		auto model = std::make_shared<Model>();
-		auto entity = std::make_shared<Entity>(model);
 		ModelOptions modelOptions;
 		if (cfg.HasMember("modelOptions")) {
 			const auto& opts = cfg["modelOptions"].GetObject();
@@ -20,13 +46,52 @@ void Scene::Load(const std::string& fileName) {
 			if(opts.HasMember("animations")) {
 				modelOptions.mAnimations = opts["animations"].GetBool();
 			}
+			if(opts.HasMember("compressAnimations")) {
+				modelOptions.mCompressAnimations = opts["compressAnimations"].GetBool();
+			}
+			if(opts.HasMember("reduceKeyFrames")) {
+				modelOptions.mReduceKeyFrames = opts["reduceKeyFrames"].GetBool();
+			}
+			if(opts.HasMember("keyFrameDistanceTolerance")) {
+				modelOptions.mKeyFrameDistanceTolerance = opts["keyFrameDistanceTolerance"].GetFloat();
+			}
+			if(opts.HasMember("keyFrameAngleTolerance")) {
+				modelOptions.mKeyFrameAngleTolerance = opts["keyFrameAngleTolerance"].GetFloat();
+			}
+			if(opts.HasMember("cache")) {
+				modelOptions.mCache = opts["cache"].GetBool();
+			}
+			if(opts.HasMember("packVertices")) {
+				modelOptions.mPackVertices = opts["packVertices"].GetBool();
+			}
+			if(opts.HasMember("optimizeMeshes")) {
+				modelOptions.mOptimizeMeshes = opts["optimizeMeshes"].GetBool();
+			}
+			if(opts.HasMember("optimizeOverdraw")) {
+				modelOptions.mOptimizeOverdraw = opts["optimizeOverdraw"].GetBool();
+			}
+			if(opts.HasMember("lodLevels")) {
+				modelOptions.mLodLevels = opts["lodLevels"].GetUint();
+			}
+			if(opts.HasMember("lodReduction")) {
+				modelOptions.mLodReduction = opts["lodReduction"].GetFloat();
+			}
+			if(opts.HasMember("lodMaxError")) {
+				modelOptions.mLodMaxError = opts["lodMaxError"].GetFloat();
+			}
 		}
-		model->Load(cfg["model"].GetString(), modelOptions);
+		std::vector<std::string> animations;
 		if (cfg.HasMember("animations")) {
 			for (const auto& anim : cfg["animations"].GetArray()) {
-				model->LoadAnimation(anim.GetString(), modelOptions, true);
+				animations.push_back(anim.GetString());
 			}
 		}
+		const std::string modelFileName = cfg["model"].GetString();
+		const auto key = ModelRegistry::GetKey(modelFileName, modelOptions, animations);
+		if (!mModels.Find(key) && importIndices.emplace(key, imports.size()).second) {
+			imports.push_back({ key, modelFileName, modelOptions, animations, nullptr });
+		}
+		auto entity = std::make_shared<Entity>();
 		if (cfg.HasMember("position")) {
 			const auto& pos = cfg["position"].GetArray();
 			entity->mPos = { pos[0].GetFloat(), pos[1].GetFloat(), pos[2].GetFloat() };
@@ -39,6 +104,181 @@ void Scene::Load(const std::string& fileName) {
 			const auto& pos = cfg["scale"].GetArray();
 			entity->mScale = { pos[0].GetFloat(), pos[1].GetFloat(), pos[2].GetFloat() };
 		}
+		if (cfg.HasMember("timeOffset")) {
+			entity->mTimeOffset = cfg["timeOffset"].GetFloat();
+		}
+		if (cfg.HasMember("skinning")) {
+			const std::string skinning = cfg["skinning"].GetString();
+			entity->mSkinning = skinning == "dualQuaternion" ? SkinningMode::DualQuaternion : SkinningMode::Linear;
+		}
+		if (!cfg.HasMember("grid")) {
+			entities.push_back({ entity, key });
+			continue;
+		}
+		// Crowds: copies of the entity on a columns x rows grid centered on its position,
+		// with their animations spread over timeSpread seconds so they don't move in sync
+		const auto& grid = cfg["grid"].GetArray();
+		const uint32_t columns = grid[0].GetUint();
+		const uint32_t rows = grid[1].GetUint();
+		const float spacing = cfg.HasMember("spacing") ? cfg["spacing"].GetFloat() : 1.0f;
+		const float timeSpread = cfg.HasMember("timeSpread") ? cfg["timeSpread"].GetFloat() : 0.0f;
+		for (uint32_t row = 0; row < rows; ++row) {
+			for (uint32_t column = 0; column < columns; ++column) {
+				auto copy = std::make_shared<Entity>(*entity);
+				copy->mPos += glm::vec3((column - (columns - 1) * 0.5f) * spacing, 0.0f, (row - (rows - 1) * 0.5f) * spacing);
+				copy->mTimeOffset += std::fmod((row * columns + column) * 0.618034f, 1.0f) * timeSpread;
+				entities.push_back({ copy, key });
+			}
+		}
+	}
+}
+
+// Every file is imported on its own, clips are merged into their model afterwards in
+// scene.json order so the result doesn't depend on which import finishes first.
+void ImportModels(std::vector<ModelImport>& imports, JobSystem& jobSystem) {
+	std::vector<FileImport> files;
+	for (size_t i = 0; i < imports.size(); ++i) {
+		files.push_back({ i, -1 });
+		for (size_t k = 0; k < imports[i].mAnimations.size(); ++k) {
+			files.push_back({ i, (int)k });
+		}
+	}
+	const auto importStart = std::chrono::high_resolution_clock::now();
+	jobSystem.ParallelFor(files.size(), 1, [&](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; ++i) {
+			auto& file = files[i];
+			const auto& modelImport = imports[file.mImport];
+			const auto fileStart = std::chrono::high_resolution_clock::now();
+			try {
+				file.mModel = std::make_shared<Model>();
+				if (file.mAnimation < 0) {
+					file.mCached = file.mModel->Import(modelImport.mFileName, modelImport.mOptions);
+				} else {
+					file.mCached = file.mModel->ImportAnimation(modelImport.mAnimations[file.mAnimation], modelImport.mOptions);
+				}
+			} catch (...) {
+				file.mError = std::current_exception();
+			}
+			file.mTime = GetMilliseconds(fileStart);
+		}
+	});
+	const double importTime = GetMilliseconds(importStart);
+	for (const auto& file : files) {
+		if (file.mError) std::rethrow_exception(file.mError);
+	}
+
+	for (auto& file : files) {
+		if (file.mAnimation < 0) imports[file.mImport].mModel = file.mModel;
+	}
+	jobSystem.ParallelFor(files.size(), 1, [&](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; ++i) {
+			const auto& file = files[i];
+			if (file.mAnimation >= 0) continue;
+			auto& modelImport = imports[file.mImport];
+			for (size_t k = 1; k <= modelImport.mAnimations.size(); ++k) {
+				modelImport.mModel->AddAnimations(*files[i + k].mModel, modelImport.mOptions);
+			}
+		}
+	});
+
+	double sequentialTime = 0.0;
+	for (const auto& file : files) {
+		const auto& modelImport = imports[file.mImport];
+		std::cout << "  " << (file.mAnimation < 0 ? modelImport.mFileName : modelImport.mAnimations[file.mAnimation]) << ": " << file.mTime << " ms" << (file.mCached ? " (cache)" : "") << std::endl;
+		sequentialTime += file.mTime;
+	}
+	for (const auto& modelImport : imports) {
+		modelImport.mModel->PrintMeshStats();
+	}
+	std::cout << "Imported " << files.size() << " files on " << jobSystem.GetThreadCount() << " threads in " << importTime << " ms, "
+		<< sequentialTime << " ms sequential" << std::endl;
+}
+
+void Scene::Load(const std::string& fileName) {
+	const auto start = std::chrono::high_resolution_clock::now();
+	std::vector<ModelImport> imports;
+	std::vector<PendingEntity> entities;
+	Parse(fileName, imports, entities);
+	if (mStreamingEnabled) {
+		Stream(std::move(imports), std::move(entities));
+		return;
+	}
+
+	ImportModels(imports, GetJobSystem());
+	for (const auto& modelImport : imports) {
+		mModels.Add(modelImport.mKey, modelImport.mModel);
+	}
+	for (auto& [entity, key] : entities) {
+		entity->mModel = mModels.Find(key);
 		mEntities.push_back(entity);
 	}
-}
\ No newline at end of file
+	std::cout << "Loaded " << fileName << " in " << GetMilliseconds(start) << " ms, "
+		<< mEntities.size() << " entities sharing " << mModels.GetLoadedCount() << " models" << std::endl;
+}
+
+void Scene::Stream(std::vector<ModelImport> imports, std::vector<PendingEntity> entities) {
+	StopStreaming();
+	mPendingEntities = std::move(entities);
+	mStreamingThread = std::thread([this, imports = std::move(imports), numThreads = mNumThreads]() mutable {
+		// Update owns the scene's job system, imports get their own threads
+		JobSystem jobSystem(numThreads);
+		for (auto& modelImport : imports) {
+			if (mStopStreaming) break;
+			std::vector<ModelImport> batch = { std::move(modelImport) };
+			try {
+				ImportModels(batch, jobSystem);
+			} catch (...) {
+				std::cerr << "Could not stream " << batch[0].mFileName << std::endl;
+				batch[0].mModel = nullptr;
+			}
+			std::lock_guard<std::mutex> lock(mStreamingMutex);
+			mStreamedImports.push_back(std::move(batch[0]));
+		}
+		mStreamingDone = true;
+	});
+}
+
+std::vector<Model_> Scene::UpdateStreaming() {
+	std::vector<Model_> models;
+	if (mPendingEntities.empty()) return models;
+	const bool done = mStreamingDone;
+	std::vector<ModelImport> finished;
+	{
+		std::lock_guard<std::mutex> lock(mStreamingMutex);
+		finished.swap(mStreamedImports);
+	}
+	for (const auto& modelImport : finished) {
+		if (!modelImport.mModel) continue;
+		modelImport.mModel->mStreaming = true;
+		mModels.Add(modelImport.mKey, modelImport.mModel);
+		models.push_back(modelImport.mModel);
+	}
+
+	// Entities keep their scene.json order among themselves, missing models are dropped at the end
+	size_t numPending = 0;
+	for (auto& pending : mPendingEntities) {
+		auto& [entity, key] = pending;
+		if (auto model = mModels.Find(key)) {
+			entity->mModel = model;
+			entity->Init();
+			mEntities.push_back(entity);
+		} else if (!done) {
+			mPendingEntities[numPending++] = std::move(pending);
+		} else {
+			std::cerr << "Dropped entity without model" << std::endl;
+		}
+	}
+	mPendingEntities.resize(numPending);
+	return models;
+}
+
+void Scene::StopStreaming() {
+	if (mStreamingThread.joinable()) {
+		mStopStreaming = true;
+		mStreamingThread.join();
+	}
+	mStopStreaming = false;
+	mStreamingDone = false;
+	mStreamedImports.clear();
+	mPendingEntities.clear();
+}
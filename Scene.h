@@ -1,7 +1,13 @@
 #pragma once
 
-#include "Main.h"
+#include "Core.h"
 #include "Model.h"
+#include "ModelRegistry.h"
+#include "JobSystem.h"
+
+#include <atomic>
+#include <mutex>
+#include <thread>
 
 struct Entity {
 	Model_ mModel = nullptr;
@@ -11,6 +17,8 @@ struct Entity {
 	glm::vec3 mUp = { 0,1,0 };
 	glm::quat mRot = { 1,0,0,0 };
 	glm::vec3 mScale = { 1,1,1 };
+	float mTimeOffset = 0.0f; // Seconds added to the scene time for this entity's animations
+	SkinningMode mSkinning = SkinningMode::Linear;
 
 	Entity() {}
 	Entity(Model_ model) : mModel(model) {}
@@ -20,12 +28,13 @@ struct Entity {
 		if (mModel && mModel->mAnimationSet) {
 			mAnimationController = std::make_shared<AnimationController>(mModel->mAnimationSet, mModel->mGlobalInverseTransform);
 			mAnimationController->SetAnimationIndex(0);
+			mAnimationController->SetSkinning(mSkinning);
 		}
 	}
 
 	void Update(float absoluteTime) {
 		if (mAnimationController) {
-			mAnimationController->Update(absoluteTime);
+			mAnimationController->Update(absoluteTime + mTimeOffset);
 		}
 	}
 
@@ -43,6 +52,20 @@ struct Entity {
 };
 typedef std::shared_ptr<Entity> Entity_;
 
+// A model with its animation files, imported concurrently by ImportModels.
+struct ModelImport {
+	std::string mKey; // ModelRegistry::GetKey
+	std::string mFileName;
+	ModelOptions mOptions;
+	std::vector<std::string> mAnimations;
+	Model_ mModel;
+};
+
+// Imports every model and merges its clips, rethrows the first error.
+void ImportModels(std::vector<ModelImport>& imports, JobSystem& jobSystem);
+
+typedef std::pair<Entity_, std::string> PendingEntity; // With its model key
+
 struct Scene {
 	std::vector<Entity_> mEntities;
 
@@ -53,18 +76,72 @@ struct Scene {
 	Entity_ mSelected;
 	size_t mSelectedIndex = -1;
 
+	ModelRegistry mModels;
+	size_t mNumThreads = 0; // Threads used by Update, 0 uses every core
+	JobSystem_ mJobSystem;
+
+	// Streaming: models are imported on a background thread and entities show up as
+	// their model finishes, see UpdateStreaming. Meshes are uploaded by MeshUploader.
+	bool mStreamingEnabled = false;
+	size_t mUploadBudget = 4 << 20; // Mesh bytes uploaded per frame while streaming
+	std::thread mStreamingThread;
+	std::mutex mStreamingMutex;
+	std::vector<ModelImport> mStreamedImports; // Guarded by mStreamingMutex
+	std::vector<PendingEntity> mPendingEntities;
+	std::atomic<bool> mStopStreaming = false;
+	std::atomic<bool> mStreamingDone = false;
+
+	~Scene() {
+		StopStreaming();
+	}
+
 	void Load(const std::string& fileName);
+	void Parse(const std::string& fileName, std::vector<ModelImport>& imports, std::vector<PendingEntity>& entities);
+
+	void Stream(std::vector<ModelImport> imports, std::vector<PendingEntity> entities);
+	// Adds the entities whose model finished importing, call once per frame from the
+	// thread that owns the scene. Returns the models that became available.
+	std::vector<Model_> UpdateStreaming();
+	// Waits for the background imports and adds the remaining entities.
+	void FinishStreaming() {
+		if (mStreamingThread.joinable()) mStreamingThread.join();
+		UpdateStreaming();
+	}
+	void StopStreaming();
+
+	bool IsStreaming() const {
+		return !mPendingEntities.empty();
+	}
 
 	void Init() {
 		for (auto& entity : mEntities) {
 			entity->Init();
 		}
+		GetJobSystem();
 	}
 
+	// Created on first use and whenever mNumThreads changes.
+	JobSystem& GetJobSystem() {
+		const size_t numThreads = mNumThreads ? mNumThreads : std::max(1u, std::thread::hardware_concurrency());
+		if (!mJobSystem || mJobSystem->GetThreadCount() != numThreads) {
+			mJobSystem = std::make_shared<JobSystem>(numThreads);
+		}
+		return *mJobSystem;
+	}
+
+	// Entities only touch their own state, so the result doesn't depend on the thread count.
 	void Update(float absoluteTime) {
-		for (auto& entity : mEntities) {
-			entity->Update(absoluteTime);
+		if (!mJobSystem) {
+			for (auto& entity : mEntities) {
+				entity->Update(absoluteTime);
+			}
+			return;
 		}
+		mJobSystem->ParallelFor(mEntities.size(), 4, [this, absoluteTime](size_t begin, size_t end) {
+			for (size_t i = begin; i < end; ++i) {
+				mEntities[i]->Update(absoluteTime);
+			}
+		});
 	}
 
 	void SelectNext() {
@@ -0,0 +1,50 @@
+#pragma once
+
+#include "Vertex.h"
+#include "DualQuat.h"
+
+// CPU reference of the skinning in default.vert.glsl, for tests and tools. Palettes are
+// indexed by Vertex::mBoneIndices, vertices without weights are returned unchanged.
+
+// Largest distance between linear and dual quaternion skinning of vertices that follow a
+// single bone, relative to the model size, checked by "AnimBench skinning".
+#define DUAL_QUATERNION_TOLERANCE 1e-4f
+
+// Weighted sum of the bone matrices, identity for vertices without weights.
+inline Affine BlendLinear(const Vertex& vertex, const Affine* palette) {
+	Affine blended;
+	if (vertex.mBoneWeights[0] <= 0.0f) return blended;
+	for (auto& row : blended.mRows) row = glm::vec4(0.0f);
+	for (size_t i = 0; i < MAX_VERTEX_WEIGHTS; ++i) {
+		const auto& bone = palette[vertex.mBoneIndices[i]];
+		for (int r = 0; r < 3; ++r) blended.mRows[r] += bone.mRows[r] * vertex.mBoneWeights[i];
+	}
+	return blended;
+}
+
+inline glm::vec3 SkinLinear(const Vertex& vertex, const Affine* palette) {
+	if (vertex.mBoneWeights[0] <= 0.0f) return vertex.mPos;
+	return BlendLinear(vertex, palette).TransformPoint(vertex.mPos);
+}
+
+// Weighted sum on the hemisphere of the first bone, renormalized.
+inline DualQuat BlendDualQuats(const Vertex& vertex, const DualQuat* palette) {
+	const auto& first = palette[vertex.mBoneIndices[0]];
+	DualQuat blended;
+	blended.mReal = glm::quat(0, 0, 0, 0);
+	for (size_t i = 0; i < MAX_VERTEX_WEIGHTS; ++i) {
+		const auto& bone = palette[vertex.mBoneIndices[i]];
+		const float weight = glm::dot(bone.mReal, first.mReal) < 0.0f ? -vertex.mBoneWeights[i] : vertex.mBoneWeights[i];
+		blended.mReal += bone.mReal * weight;
+		blended.mDual += bone.mDual * weight;
+	}
+	const float length = glm::length(blended.mReal);
+	blended.mReal = blended.mReal / length;
+	blended.mDual = blended.mDual / length;
+	return blended;
+}
+
+inline glm::vec3 SkinDualQuaternion(const Vertex& vertex, const DualQuat* palette) {
+	if (vertex.mBoneWeights[0] <= 0.0f) return vertex.mPos;
+	return BlendDualQuats(vertex, palette).TransformPoint(vertex.mPos);
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include "Main.h"
+
+// Per frame data written by the CPU and read by the GPU without the driver synchronizing.
+// The buffer is mapped once, persistently and coherently, and split into one region per
+// frame in flight. Each frame writes the next region after waiting on the fence placed
+// when that region was last drawn from, which only blocks when the GPU is that far behind.
+// Regions grow to the largest frame seen, which waits for every frame in flight once.
+
+#define STREAM_BUFFER_FRAMES 3
+#define STREAM_BUFFER_ALIGNMENT 256 // Largest offset alignment GL allows for storage and uniform buffers
+
+struct StreamBuffer {
+	GLenum mTarget;
+	GLuint mBuffer = 0;
+	uint8_t* mMapping = nullptr;
+	size_t mRegionSize = 0; // Bytes per frame
+	size_t mRegion = 0; // Written by the current frame
+	GLsync mFences[STREAM_BUFFER_FRAMES] = {};
+	size_t mWaits = 0; // Regions that were still in use by the GPU
+
+	StreamBuffer(const GLenum target) : mTarget(target) {}
+	StreamBuffer(const StreamBuffer&) = delete;
+	StreamBuffer& operator=(const StreamBuffer&) = delete;
+	~StreamBuffer() {
+		Release();
+	}
+
+	// Returns this frame's region, room for at least bytes.
+	uint8_t* Begin(const size_t bytes) {
+		mRegion = (mRegion + 1) % STREAM_BUFFER_FRAMES;
+		if (bytes > mRegionSize) {
+			Allocate(std::max(bytes, mRegionSize * 2));
+		} else {
+			Wait(mRegion);
+		}
+		return mMapping + GetOffset();
+	}
+
+	// Marks the region as in use by everything submitted so far, call after the draws reading it.
+	void End() {
+		if (mFences[mRegion]) glDeleteSync(mFences[mRegion]);
+		mFences[mRegion] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	}
+
+	size_t GetOffset() const {
+		return mRegion * mRegionSize;
+	}
+
+protected:
+	void Wait(const size_t region) {
+		auto& fence = mFences[region];
+		if (!fence) return;
+		GLenum result = glClientWaitSync(fence, 0, 0);
+		if (result != GL_ALREADY_SIGNALED) {
+			mWaits++;
+			while (result == GL_TIMEOUT_EXPIRED) {
+				result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+			}
+		}
+		glDeleteSync(fence);
+		fence = nullptr;
+	}
+
+	void Release() {
+		for (size_t region = 0; region < STREAM_BUFFER_FRAMES; ++region) Wait(region);
+		if (mBuffer) {
+			glBindBuffer(mTarget, mBuffer);
+			glUnmapBuffer(mTarget);
+			glBindBuffer(mTarget, 0);
+			glDeleteBuffers(1, &mBuffer);
+		}
+		mBuffer = 0;
+		mMapping = nullptr;
+	}
+
+	void Allocate(const size_t bytes) {
+		Release();
+		mRegionSize = (bytes + STREAM_BUFFER_ALIGNMENT - 1) / STREAM_BUFFER_ALIGNMENT * STREAM_BUFFER_ALIGNMENT;
+		const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		glGenBuffers(1, &mBuffer);
+		glBindBuffer(mTarget, mBuffer);
+		glBufferStorage(mTarget, mRegionSize * STREAM_BUFFER_FRAMES, nullptr, flags);
+		mMapping = (uint8_t*)glMapBufferRange(mTarget, 0, mRegionSize * STREAM_BUFFER_FRAMES, flags);
+		glBindBuffer(mTarget, 0);
+	}
+};
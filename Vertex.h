@@ -1,6 +1,11 @@
 #pragma once
 
+// HEADLESS builds leave out everything that needs GL
+#ifdef HEADLESS
+#include "Core.h"
+#else
 #include "Main.h"
+#endif
 
 struct Vertex {
 	glm::vec3 mPos = { 0, 0, 0 };
@@ -21,6 +26,7 @@ struct Vertex {
 		return false;
 	}
 
+#ifndef HEADLESS
 	/*layout(location = 0) in vec3 inPosition;
 	layout(location = 1) in vec3 inNormal;
 	layout(location = 2) in vec3 inColor;
@@ -38,6 +44,98 @@ struct Vertex {
 		attr(3, GL_FLOAT, offsetof(Vertex, mNormal));
 		attr(3, GL_FLOAT, offsetof(Vertex, mColor));
 		attr(MAX_VERTEX_WEIGHTS, GL_FLOAT, offsetof(Vertex, mBoneWeights));
-		attr(MAX_VERTEX_WEIGHTS, GL_FLOAT, offsetof(Vertex, mBoneIndices)); // NOTE: GL_UNSIGNED_INT does not work here for some reason
+		glEnableVertexAttribArray(index);
+		glVertexAttribIPointer(index, MAX_VERTEX_WEIGHTS, GL_UNSIGNED_INT, sizeof(Vertex), (GLvoid*)offsetof(Vertex, mBoneIndices));
 	}
+#endif
+};
+
+// Quantized Vertex for the GPU, 28 instead of 68 bytes. Positions are 16-bit fractions of
+// the mesh AABB (offset and scale are passed to the shader per mesh), normals are octahedral
+// encoded into two 16-bit components, weights are 8-bit and sum to exactly 255.
+struct PackedVertex {
+	uint16_t mPos[4] = { 0 }; // w is padding
+	int16_t mNormal[2] = { 0 };
+	uint8_t mColor[4] = { 0 };
+	uint8_t mBoneWeights[MAX_VERTEX_WEIGHTS] = { 0 };
+	uint16_t mBoneIndices[MAX_VERTEX_WEIGHTS] = { 0 };
+
+	// Maps the unit vector onto an octahedron and unfolds its lower half over the upper one.
+	static glm::vec2 EncodeOctahedral(const glm::vec3& normal) {
+		const float length = std::abs(normal.x) + std::abs(normal.y) + std::abs(normal.z);
+		if (length == 0.0f) return { 0, 0 };
+		const glm::vec3 n = normal / length;
+		if (n.z >= 0.0f) return { n.x, n.y };
+		return {
+			(1.0f - std::abs(n.y)) * (n.x >= 0.0f ? 1.0f : -1.0f),
+			(1.0f - std::abs(n.x)) * (n.y >= 0.0f ? 1.0f : -1.0f)
+		};
+	}
+
+	static glm::vec3 DecodeOctahedral(const glm::vec2& e) {
+		glm::vec3 n = { e.x, e.y, 1.0f - std::abs(e.x) - std::abs(e.y) };
+		const float t = std::max(-n.z, 0.0f);
+		n.x += n.x >= 0.0f ? -t : t;
+		n.y += n.y >= 0.0f ? -t : t;
+		return glm::normalize(n);
+	}
+
+	static PackedVertex Pack(const Vertex& vertex, const glm::vec3& offset, const glm::vec3& scale) {
+		PackedVertex packed;
+		for (int c = 0; c < 3; ++c) {
+			const float position = scale[c] > 0.0f ? (vertex.mPos[c] - offset[c]) / scale[c] : 0.0f;
+			packed.mPos[c] = (uint16_t)std::lround(glm::clamp(position, 0.0f, 1.0f) * 65535.0f);
+			packed.mColor[c] = (uint8_t)std::lround(glm::clamp(vertex.mColor[c], 0.0f, 1.0f) * 255.0f);
+		}
+		const auto normal = EncodeOctahedral(vertex.mNormal);
+		packed.mNormal[0] = (int16_t)std::lround(glm::clamp(normal.x, -1.0f, 1.0f) * 32767.0f);
+		packed.mNormal[1] = (int16_t)std::lround(glm::clamp(normal.y, -1.0f, 1.0f) * 32767.0f);
+
+		float sum = 0.0f;
+		for (size_t i = 0; i < MAX_VERTEX_WEIGHTS; ++i) sum += vertex.mBoneWeights[i];
+		if (sum <= 0.0f) return packed;
+		int total = 0;
+		size_t largest = 0;
+		for (size_t i = 0; i < MAX_VERTEX_WEIGHTS; ++i) {
+			packed.mBoneWeights[i] = (uint8_t)std::lround(vertex.mBoneWeights[i] / sum * 255.0f);
+			packed.mBoneIndices[i] = (uint16_t)vertex.mBoneIndices[i];
+			total += packed.mBoneWeights[i];
+			if (vertex.mBoneWeights[i] > vertex.mBoneWeights[largest]) largest = i;
+		}
+		// Rounding errors go to the largest weight, the shader relies on the first weight being non zero
+		packed.mBoneWeights[largest] = (uint8_t)(packed.mBoneWeights[largest] + 255 - total);
+		return packed;
+	}
+
+	Vertex Unpack(const glm::vec3& offset, const glm::vec3& scale) const {
+		Vertex vertex;
+		for (int c = 0; c < 3; ++c) {
+			vertex.mPos[c] = offset[c] + mPos[c] / 65535.0f * scale[c];
+			vertex.mColor[c] = mColor[c] / 255.0f;
+		}
+		if (mNormal[0] != 0 || mNormal[1] != 0) {
+			vertex.mNormal = DecodeOctahedral({ std::max(mNormal[0] / 32767.0f, -1.0f), std::max(mNormal[1] / 32767.0f, -1.0f) });
+		}
+		for (size_t i = 0; i < MAX_VERTEX_WEIGHTS; ++i) {
+			vertex.mBoneWeights[i] = mBoneWeights[i] / 255.0f;
+			vertex.mBoneIndices[i] = mBoneIndices[i];
+		}
+		return vertex;
+	}
+
+#ifndef HEADLESS
+	// Same locations as Vertex, except the normal which the shader decodes from location 5
+	static void MapVertexArray() {
+		auto attr = [](GLuint index, GLuint size, GLenum type, size_t offset) {
+			glEnableVertexAttribArray(index);
+			glVertexAttribPointer(index, size, type, GL_TRUE, sizeof(PackedVertex), (GLvoid*)offset);
+		};
+		attr(0, 3, GL_UNSIGNED_SHORT, offsetof(PackedVertex, mPos));
+		attr(5, 2, GL_SHORT, offsetof(PackedVertex, mNormal));
+		attr(2, 3, GL_UNSIGNED_BYTE, offsetof(PackedVertex, mColor));
+		attr(3, MAX_VERTEX_WEIGHTS, GL_UNSIGNED_BYTE, offsetof(PackedVertex, mBoneWeights));
+		glEnableVertexAttribArray(4);
+		glVertexAttribIPointer(4, MAX_VERTEX_WEIGHTS, GL_UNSIGNED_SHORT, sizeof(PackedVertex), (GLvoid*)offsetof(PackedVertex, mBoneIndices));
+	}
+#endif
 };
@@ -1,32 +1,91 @@
 #version 450
 
-#define MAX_BONES 1000
+#define DRAW_FLAG_PACKED 1u
+#define DRAW_FLAG_SKINNED 2u
+#define DRAW_FLAG_DUAL_QUATERNION 4u
 
 layout(location=0) uniform mat4 uProj;
 layout(location=1) uniform mat4 uView;
-layout(location=2) uniform mat4 uModel;
-layout(location=3) uniform mat4 uBones[MAX_BONES];
+
+// Renderer.h: one entry per draw, selected by the draw's baseInstance through inDrawIndex
+// Affine transforms are mat3x4 holding the rows of the matrix, applied as vec4(p, 1.0) * m
+struct DrawData {
+    mat3x4 model;
+    vec4 positionOffset; // PackedVertex: positions are fractions of the mesh AABB
+    vec4 positionScale;
+    uint boneOffset;
+    uint flags;
+    uint padding0;
+    uint padding1;
+};
+layout(std430, binding=0) readonly buffer DrawBuffer {
+    DrawData uDraws[];
+};
+// Per bone 3 vec4 of a mat3x4, or 2 vec4 of a dual quaternion (real, dual) with DRAW_FLAG_DUAL_QUATERNION
+layout(std430, binding=1) readonly buffer BoneBuffer {
+    vec4 uBones[];
+};
 
 layout(location=0) in vec3 inPosition;
 layout(location=1) in vec3 inNormal;
 layout(location=2) in vec3 inColor;
 layout(location=3) in vec4 inBoneWeights;
 layout(location=4) in uvec4 inBoneIndices;
+layout(location=5) in vec2 inPackedNormal; // PackedVertex: octahedral encoded
+layout(location=6) in uint inDrawIndex;
 
 layout(location=0) out vec3 outColor;
 layout(location=1) out vec3 outNormal;
 layout(location=2) out vec3 outPosition;
 
+mat3x4 GetBoneMatrix(uint offset, uint bone) {
+    uint i = offset + bone * 3u;
+    return mat3x4(uBones[i], uBones[i + 1u], uBones[i + 2u]);
+}
+
+// Blends on the hemisphere of the first bone, see BlendDualQuats in Skinning.h
+vec3 SkinDualQuaternion(vec3 p, uint offset) {
+    vec4 first = uBones[offset + inBoneIndices[0] * 2u];
+    vec4 real = vec4(0.0);
+    vec4 dual = vec4(0.0);
+    for(int i = 0; i < 4; ++i) {
+        uint bone = offset + inBoneIndices[i] * 2u;
+        float weight = dot(uBones[bone], first) < 0.0 ? -inBoneWeights[i] : inBoneWeights[i];
+        real += uBones[bone] * weight;
+        dual += uBones[bone + 1u] * weight;
+    }
+    float len = length(real);
+    real /= len;
+    dual /= len;
+    vec3 rotated = cross(real.xyz, cross(real.xyz, p) + real.w * p);
+    vec3 translation = real.w * dual.xyz - dual.w * real.xyz + cross(real.xyz, dual.xyz);
+    return p + 2.0 * (rotated + translation);
+}
+
+vec3 DecodeOctahedral(vec2 e) {
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    float t = max(-n.z, 0.0);
+    n.xy += mix(vec2(t), vec2(-t), greaterThanEqual(n.xy, vec2(0.0)));
+    return normalize(n);
+}
+
 void main() {
-    if(inBoneWeights[0] > 0.0) {
-        mat4 boneTransform = uBones[inBoneIndices[0]] * inBoneWeights[0];
-        boneTransform += uBones[inBoneIndices[1]] * inBoneWeights[1];
-        boneTransform += uBones[inBoneIndices[2]] * inBoneWeights[2];
-        boneTransform += uBones[inBoneIndices[3]] * inBoneWeights[3];
+    DrawData draw = uDraws[inDrawIndex];
+    mat3x4 model = draw.model;
+    vec3 position = draw.positionOffset.xyz + inPosition * draw.positionScale.xyz;
+    vec3 normal = (draw.flags & DRAW_FLAG_PACKED) != 0u ? DecodeOctahedral(inPackedNormal) : inNormal;
+
+    if((draw.flags & DRAW_FLAG_DUAL_QUATERNION) != 0u && inBoneWeights[0] > 0.0) {
+        gl_Position = uProj * uView * vec4(vec4(SkinDualQuaternion(position, draw.boneOffset), 1.0) * model, 1.0);
+    } else if((draw.flags & DRAW_FLAG_SKINNED) != 0u && inBoneWeights[0] > 0.0) {
+        mat3x4 boneTransform = GetBoneMatrix(draw.boneOffset, inBoneIndices[0]) * inBoneWeights[0];
+        boneTransform += GetBoneMatrix(draw.boneOffset, inBoneIndices[1]) * inBoneWeights[1];
+        boneTransform += GetBoneMatrix(draw.boneOffset, inBoneIndices[2]) * inBoneWeights[2];
+        boneTransform += GetBoneMatrix(draw.boneOffset, inBoneIndices[3]) * inBoneWeights[3];
 
-        gl_Position = uProj * uView * uModel * boneTransform * vec4(inPosition, 1.0);
+        gl_Position = uProj * uView * vec4(vec4(vec4(position, 1.0) * boneTransform, 1.0) * model, 1.0);
     } else {
-        gl_Position = uProj * uView * uModel * vec4(inPosition, 1.0);
+        gl_Position = uProj * uView * vec4(vec4(position, 1.0) * model, 1.0);
     }
 
     outColor = inColor;
@@ -34,6 +93,7 @@ void main() {
     //outColor = vec3(inBoneWeights[0], inBoneWeights[1], inBoneWeights[2]);
     //outColor = vec3(inBoneIndices[0], inBoneIndices[1], inBoneIndices[2]);
 
-    outPosition = vec3(uModel * vec4(inPosition, 1.0));
-    outNormal = mat3(transpose(inverse(uModel))) * inNormal;
+    outPosition = vec4(position, 1.0) * model;
+    // mat3(model) is the transposed linear part, so this is its inverse transpose
+    outNormal = inverse(mat3(model)) * normal;
 }
@@ -2,26 +2,26 @@
 
 layout(location=0) uniform mat4 uProj;
 layout(location=1) uniform mat4 uView;
-layout(location=2) uniform mat4 uModel;
-layout(location=3) uniform float uTime;
 
+// Per instance, see DebugPoint
 layout(location=0) in vec3 inPosition;
-layout(location=1) in vec3 inNormal;
+layout(location=1) in float inScale;
 layout(location=2) in vec3 inColor;
 
 layout(location=0) out vec3 outColor;
 
+const vec2 corners[6] = vec2[](
+    vec2(0.0, 0.0), vec2(1.0, 0.0), vec2(1.0, 1.0),
+    vec2(0.0, 0.0), vec2(1.0, 1.0), vec2(0.0, 1.0)
+);
+
 void main() {
-    float scale = inNormal.z;
-    vec3 center = inPosition;
-    mat4 viewModel = uView * uModel;
-    vec3 camRight = vec3(viewModel[0][0], viewModel[1][0], viewModel[2][0]);
-    vec3 camUp = vec3(viewModel[0][1], viewModel[1][1], viewModel[2][1]);
-    vec3 pos = center
-             + camRight * inNormal.x * scale
-             + camUp * inNormal.y * scale;
+    vec2 corner = (corners[gl_VertexID] - 0.5) * 0.25 * inScale;
+    vec3 camRight = vec3(uView[0][0], uView[1][0], uView[2][0]);
+    vec3 camUp = vec3(uView[0][1], uView[1][1], uView[2][1]);
+    vec3 pos = inPosition + camRight * corner.x + camUp * corner.y;
 
-    gl_Position = uProj * uView * uModel * vec4(pos, 1.0);
+    gl_Position = uProj * uView * vec4(pos, 1.0);
 
     outColor = inColor;
 }